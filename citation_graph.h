@@ -1,10 +1,37 @@
 #ifndef CITATION_GRAPH_H
 #define CITATION_GRAPH_H
 
-#include <vector>
-#include <memory>
-#include <set>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CITATION_GRAPH_HAS_MMAP 1
+#endif
 
 
 class PublicationNotFound : public std::exception {
@@ -25,156 +52,3374 @@ class TriedToRemoveRoot : public std::exception {
     }
 };
 
-template <class Publication>
-class CitationGraph {
+class CitationCycle : public std::exception {
+    const char * what () const noexcept override {
+        return "CitationCycle";
+    }
+};
+
+class InvalidSnapshot : public std::exception {
+    const char * what () const noexcept override {
+        return "InvalidSnapshot";
+    }
+};
+
+class TransactionInProgress : public std::exception {
+    const char * what () const noexcept override {
+        return "TransactionInProgress";
+    }
+};
+
+// How publication ids are stored in snapshots. Each id gets its own byte range
+// in the id table, so read() is handed exactly the bytes write() produced.
+// Trivially copyable ids are stored as raw bytes and std::string as its
+// characters; specialize this for any other id type.
+template <class Id, class Enable = void>
+struct CitationIdCodec;
+
+template <class Id>
+struct CitationIdCodec<Id, std::enable_if_t<std::is_trivially_copyable<Id>::value> > {
+    static void write(std::string &out, Id const &id) {
+        out.append(reinterpret_cast<char const *>(&id), sizeof(Id));
+    }
+
+    static Id read(char const *first, char const *last) {
+        if (std::size_t(last - first) != sizeof(Id))
+            throw InvalidSnapshot();
+        Id id;
+        std::memcpy(static_cast<void *>(&id), first, sizeof(Id));
+        return id;
+    }
+};
+
+template <>
+struct CitationIdCodec<std::string> {
+    static void write(std::string &out, std::string const &id) {
+        out.append(id);
+    }
+
+    static std::string read(char const *first, char const *last) {
+        return std::string(first, last);
+    }
+};
+
+namespace citation_graph_detail {
+
+// Nodes live in fixed-size chunks, so growing the arena never moves them and
+// references handed out by CitationGraph::operator[] stay valid. Chunks come
+// from the given memory resource, and a T constructible from the resource is
+// handed it, so that its own containers can allocate from it too.
+template <class T, std::size_t ChunkBits = 9>
+class chunked_arena {
+public:
+    static constexpr std::size_t chunk_size = std::size_t(1) << ChunkBits;
+
+    explicit chunked_arena(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) noexcept
+            : deleter {resource} {}
+
+    std::pmr::memory_resource *resource() const noexcept {
+        return deleter.resource;
+    }
+
+    std::size_t size() const noexcept {
+        return count;
+    }
+
+    T &operator[](std::size_t i) const noexcept {
+        return chunks[i >> ChunkBits].get()[i & (chunk_size - 1)];
+    }
+
+    // Appends a default-constructed slot. Strong guarantee.
+    std::size_t grow() {
+        if (count == chunks.size() * chunk_size)
+            add_chunk();
+        return count++;
+    }
+
+    // Allocates chunks for up to n slots ahead of time.
+    void reserve(std::size_t n) {
+        chunks.reserve((n + chunk_size - 1) / chunk_size);
+        while (chunks.size() * chunk_size < n)
+            add_chunk();
+    }
+
+    // Forgets the last slot; the caller must have reset it to its default state.
+    void shrink() noexcept {
+        --count;
+    }
+
+    void swap(chunked_arena &other) noexcept {
+        chunks.swap(other.chunks);
+        std::swap(count, other.count);
+        std::swap(deleter, other.deleter);
+    }
 
 private:
-    class Node
-            : public std::enable_shared_from_this<Node>
-{
-    public:
-        Publication publication;
-        std::set<std::shared_ptr<Node> > children;
-        std::set<std::weak_ptr<Node>, std::owner_less<std::weak_ptr<Node> > > parents;
-        Node (typename Publication::id_type const &stem_id)
-                : publication(stem_id) {}
+    struct chunk_deleter {
+        std::pmr::memory_resource *resource;
 
+        void operator()(T *chunk) const noexcept {
+            for (std::size_t i = chunk_size; i-- > 0;)
+                chunk[i].~T();
+            resource -> deallocate(chunk, chunk_size * sizeof(T), alignof(T));
+        }
+    };
 
-        ~Node() {
-            auto removed = this -> weak_from_this();
-            for (auto child : children) {
-                child -> parents.erase(removed);
+    void add_chunk() {
+        chunks.reserve(chunks.size() + 1);
+        T *chunk = static_cast<T *>(deleter.resource -> allocate(chunk_size * sizeof(T), alignof(T)));
+        std::size_t built = 0;
+        try {
+            for (; built < chunk_size; ++built) {
+                if constexpr (std::is_constructible<T, std::pmr::memory_resource *>::value)
+                    new (chunk + built) T(deleter.resource);
+                else
+                    new (chunk + built) T();
             }
+        } catch (...) {
+            while (built-- > 0)
+                chunk[built].~T();
+            deleter.resource -> deallocate(chunk, chunk_size * sizeof(T), alignof(T));
+            throw;
+        }
+        chunks.emplace_back(chunk, deleter);
+    }
+
+    std::vector<std::unique_ptr<T, chunk_deleter> > chunks;
+    std::size_t count = 0;
+    chunk_deleter deleter;
+};
 
+// Adjacency is kept in sorted lists of node indices. Every mutation first
+// makes room with reserve_one(), so the insert itself cannot throw.
+template <class Vector>
+void reserve_one(Vector &v) {
+    if (v.size() == v.capacity())
+        v.reserve(std::max<std::size_t>(4, 2 * v.capacity()));
+}
+
+template <class Vector>
+void reserve_more(Vector &v, std::size_t extra) {
+    if (v.size() + extra > v.capacity())
+        v.reserve(std::max(v.size() + extra, 2 * v.capacity()));
+}
+
+inline unsigned popcount64(std::uint64_t word) noexcept {
+#if defined(__GNUC__)
+    return unsigned(__builtin_popcountll(word));
+#else
+    unsigned count = 0;
+    for (; word != 0; word &= word - 1)
+        ++count;
+    return count;
+#endif
+}
+
+inline std::uint64_t mix64(std::uint64_t h) noexcept {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Stands in for a node's copy of its id when the publication's own is used.
+struct no_id_copy {};
+
+// Visited flags for graph walks that can be cleared in O(1) by bumping the
+// epoch, so a small walk over a large graph does not pay for the whole graph.
+class visit_marks {
+public:
+    // Starts a new walk over slots [0, size). May throw only before any mark.
+    void reset(std::size_t size) {
+        if (marks.size() < size)
+            marks.resize(size);
+        if (++epoch == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
         }
-    };
+    }
 
-    std::shared_ptr<Node> root;
-    std::map <typename Publication::id_type, std::weak_ptr<Node> > map;
+    bool visited(std::size_t slot) const noexcept {
+        return marks[slot] == epoch;
+    }
+
+    // Returns true the first time a slot is visited during the current walk.
+    bool visit(std::size_t slot) noexcept {
+        if (marks[slot] == epoch)
+            return false;
+        marks[slot] = epoch;
+        return true;
+    }
+
+    void swap(visit_marks &other) noexcept {
+        marks.swap(other.marks);
+        std::swap(epoch, other.epoch);
+    }
+
+private:
+    std::vector<std::uint32_t> marks;
+    std::uint32_t epoch = 0;
+};
 
+// Keys ordered by a count that only ever moves by one, highest first. Keys
+// with equal counts form one run, so changing a count swaps the key with
+// the first or last key of its run and shifts the boundary between the two
+// runs: O(1), and allocation-free once reserve() has made room.
+class ranked_counts {
 public:
-    CitationGraph(typename Publication::id_type const &stem_id) {
-        root = std::make_shared<Node>(stem_id);
-        map[stem_id] = root;
+    // Room for keys below bound and counts up to most. Strong guarantee.
+    void reserve(std::size_t bound, std::size_t most) {
+        if (bound > ranked.size())
+            reserve_more(ranked, bound - ranked.size());
+        if (place.size() < bound) {
+            place.resize(bound);
+            counts.resize(bound);
+        }
+        if (atLeast.size() < most + 1)
+            atLeast.resize(most + 1);
     }
 
-    CitationGraph(CitationGraph<Publication> &&other) noexcept {
-        *this = std::move(other);
+    // Replaces the contents with keys, each with count(key). Strong guarantee.
+    template <class Count>
+    void assign(std::size_t bound, std::vector<std::uint32_t> const &keys, Count &&count) {
+        ranked_counts fresh;
+        std::size_t most = 0;
+        for (auto key : keys)
+            most = std::max<std::size_t>(most, count(key));
+        fresh.reserve(bound, most);
+        fresh.ranked.resize(keys.size());
+        for (auto key : keys) {
+            fresh.counts[key] = std::uint32_t(count(key));
+            ++fresh.atLeast[fresh.counts[key]];
+        }
+        for (std::size_t c = most; c > 0; --c)
+            fresh.atLeast[c - 1] += fresh.atLeast[c];
+        // Fills each run from its back.
+        std::vector<std::uint32_t> next(fresh.atLeast);
+        for (auto key : keys) {
+            fresh.place[key] = --next[fresh.counts[key]];
+            fresh.ranked[fresh.place[key]] = key;
+        }
+        swap(fresh);
     }
-    CitationGraph<Publication>& operator=(CitationGraph<Publication> &&other) {
-        root.swap( other.root);
-        map.swap(other.map);
+
+    // Adds key with a count of zero; needs room for it.
+    void insert(std::uint32_t key) noexcept {
+        place[key] = std::uint32_t(ranked.size());
+        counts[key] = 0;
+        ranked.push_back(key);
+    }
+
+    // Needs room for the new count.
+    void raise(std::uint32_t key) noexcept {
+        std::uint32_t count = counts[key];
+        move_to(key, atLeast[count + 1]++);
+        ++counts[key];
+    }
+
+    void lower(std::uint32_t key) noexcept {
+        std::uint32_t count = counts[key];
+        move_to(key, --atLeast[count]);
+        --counts[key];
+    }
+
+    void erase(std::uint32_t key) noexcept {
+        while (counts[key] != 0)
+            lower(key);
+        move_to(key, std::uint32_t(ranked.size() - 1));
+        ranked.pop_back();
+    }
+
+    std::size_t count(std::uint32_t key) const noexcept {
+        return counts[key];
+    }
+
+    // Highest count first.
+    std::vector<std::uint32_t> const &keys() const noexcept {
+        return ranked;
+    }
+
+    void swap(ranked_counts &other) noexcept {
+        ranked.swap(other.ranked);
+        place.swap(other.place);
+        counts.swap(other.counts);
+        atLeast.swap(other.atLeast);
+    }
+
+private:
+    void move_to(std::uint32_t key, std::uint32_t position) noexcept {
+        std::uint32_t other = ranked[position];
+        ranked[place[key]] = other;
+        place[other] = place[key];
+        ranked[position] = key;
+        place[key] = position;
+    }
+
+    std::vector<std::uint32_t> ranked;
+    // By key: position in ranked, and count.
+    std::vector<std::uint32_t> place;
+    std::vector<std::uint32_t> counts;
+    // atLeast[c], for c > 0, is the number of keys counted c or more, so
+    // the run of count c is ranked[atLeast[c + 1], atLeast[c]).
+    std::vector<std::uint32_t> atLeast;
+};
+
+template <class Vector, class Index>
+bool contains_sorted(Vector const &v, Index x) noexcept {
+    return std::binary_search(v.begin(), v.end(), x);
+}
+
+template <class Vector, class Index>
+void insert_sorted(Vector &v, Index x) noexcept {
+    v.insert(std::upper_bound(v.begin(), v.end(), x), x);
+}
+
+template <class Vector, class Index>
+void erase_sorted(Vector &v, Index x) noexcept {
+    auto it = std::lower_bound(v.begin(), v.end(), x);
+    if (it != v.end() && *it == x)
+        v.erase(it);
+}
+
+// A sorted list of node indices: a publication's children or parents.
+// Erasing from a short list shifts the rest down at once. A long one, such
+// as the children of a heavily cited hub, only marks the entry, and marked
+// entries are squeezed out together once they make up half of the list, so
+// an erase costs O(log d) amortized instead of moving up to d entries.
+// Iteration skips marked entries; indices must be below marked.
+class adjacency_list {
+public:
+    using value_type = std::uint32_t;
+    using allocator_type = std::pmr::polymorphic_allocator<std::uint32_t>;
+
+    static constexpr std::uint32_t marked = std::uint32_t(1) << 31;
+    // Lists shorter than this are never marked.
+    static constexpr std::size_t eager = 64;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::uint32_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::uint32_t const *;
+        using reference = std::uint32_t const &;
+
+        const_iterator() = default;
+
+        reference operator*() const noexcept {
+            return *position;
+        }
+        const_iterator &operator++() noexcept {
+            ++position;
+            skip();
+            return *this;
+        }
+        const_iterator operator++(int) noexcept {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        bool operator==(const_iterator const &other) const noexcept {
+            return position == other.position;
+        }
+        bool operator!=(const_iterator const &other) const noexcept {
+            return position != other.position;
+        }
+
+    private:
+        friend class adjacency_list;
+        const_iterator(pointer position, pointer last) noexcept : position(position), last(last) {
+            skip();
+        }
+
+        void skip() noexcept {
+            while (position != last && (*position & marked))
+                ++position;
+        }
+
+        pointer position = nullptr;
+        pointer last = nullptr;
+    };
+    using iterator = const_iterator;
+
+    adjacency_list() = default;
+
+    explicit adjacency_list(allocator_type allocator) noexcept : items(allocator) {}
+
+    // From sorted, distinct indices.
+    template <class Iterator>
+    adjacency_list(Iterator first, Iterator last, allocator_type allocator) : items(first, last, allocator) {}
+
+    adjacency_list(adjacency_list &&) noexcept = default;
+    adjacency_list &operator=(adjacency_list &&) noexcept = default;
+
+    // Keeps this list's allocator; drops the other's marked entries.
+    adjacency_list &operator=(adjacency_list const &other) {
+        items.assign(other.begin(), other.end());
+        erasedCount = 0;
         return *this;
     }
 
-    typename Publication::id_type get_root_id() const noexcept(noexcept(std::declval<Publication>().get_id())) {
-        return root -> publication.get_id();
+    allocator_type get_allocator() const noexcept {
+        return items.get_allocator();
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(items.data(), items.data() + items.size());
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(items.data() + items.size(), items.data() + items.size());
+    }
+    std::size_t size() const noexcept {
+        return items.size() - erasedCount;
+    }
+    bool empty() const noexcept {
+        return size() == 0;
+    }
 
+    // Entries the list holds without allocating; marked ones are squeezed
+    // out to make room when needed.
+    std::size_t capacity() const noexcept {
+        return items.capacity();
+    }
+    void reserve(std::size_t n) {
+        if (n > items.capacity())
+            items.reserve(std::max(n, items.size()));
+    }
 
+    // Every entry, marked ones included; see marked.
+    std::pmr::vector<std::uint32_t> const &entries() const noexcept {
+        return items;
     }
 
-    std::vector<typename Publication::id_type> get_children(typename Publication::id_type const &id) const {
-        if (!exists(id))
-            throw PublicationNotFound();
+    bool contains(std::uint32_t x) const noexcept {
+        auto it = lower_bound(items, x);
+        return it != items.end() && *it == x;
+    }
 
-        std::vector<typename Publication::id_type> result;
-        std::shared_ptr<Node> myNode = map.at(id).lock();
-        for (auto child : myNode -> children) {
-            result.push_back(child -> publication.get_id());
+    // x must not be listed yet, and size() must be below capacity().
+    void insert(std::uint32_t x) noexcept {
+        auto it = lower_bound(items, x);
+        // A marked neighbour can be overwritten without breaking the order.
+        if (it != items.end() && (*it & marked)) {
+            *it = x;
+            --erasedCount;
+            return;
         }
-        return result;
+        if (it != items.begin() && (it[-1] & marked)) {
+            it[-1] = x;
+            --erasedCount;
+            return;
+        }
+        if (items.size() == items.capacity()) {
+            compact();
+            it = lower_bound(items, x);
+        }
+        items.insert(it, x);
     }
 
-    std::vector<typename Publication::id_type> get_parents(typename Publication::id_type const &id) const {
-        if (!exists(id))
-            throw PublicationNotFound();
-        std::vector<typename Publication::id_type> result;
-        std::shared_ptr<Node> myNode = map.at(id).lock();
-        for (auto parent : myNode -> parents) {
-            if (std::shared_ptr<Node> parent2 = parent.lock())
-                result.push_back(parent2 -> publication.get_id());
+    void erase(std::uint32_t x) noexcept {
+        auto it = lower_bound(items, x);
+        if (it == items.end() || *it != x)
+            return;
+        if (items.size() < eager || it + 1 == items.end()) {
+            items.erase(it);
+            return;
         }
-        return result;
+        *it |= marked;
+        if (2 * ++erasedCount > items.size())
+            compact();
     }
 
-    bool exists(typename Publication::id_type const &id) const {
-        auto checkNode = map.find(id);
-        if (checkNode == map.end()) return false;
-        if (checkNode -> second.expired()) return false;
-        return true;
+    // Erases every entry for which doomed(entry) holds in one pass.
+    template <class Predicate>
+    void erase_if(Predicate &&doomed) noexcept {
+        items.erase(std::remove_if(items.begin(), items.end(), [&doomed](std::uint32_t entry) {
+            return (entry & marked) || doomed(entry);
+        }), items.end());
+        erasedCount = 0;
     }
 
-    Publication& operator[](typename Publication::id_type const &id) const {
-        if (!exists(id))
-            throw PublicationNotFound();
+    // Adds index(e) for each e in [first, last), sorted by it and not
+    // listed yet; needs room for them.
+    template <class Iterator, class Index>
+    void merge(Iterator first, Iterator last, Index &&index) noexcept {
+        compact();
+        std::size_t previous = items.size();
+        for (; first != last; ++first)
+            items.push_back(index(*first));
+        std::inplace_merge(items.begin(), items.begin() + std::ptrdiff_t(previous), items.end());
+    }
 
-        std::shared_ptr<Node> myNode = map.at(id).lock();
-        return myNode -> publication;
+    void compact() noexcept {
+        if (erasedCount != 0)
+            erase_if([](std::uint32_t) { return false; });
     }
 
-    void create(typename Publication::id_type const &id, typename Publication::id_type const &parent_id) {
-        create(id, std::vector<typename Publication::id_type> {parent_id});
+    void swap(adjacency_list &other) noexcept {
+        items.swap(other.items);
+        std::swap(erasedCount, other.erasedCount);
     }
-    void create(typename Publication::id_type const &id, std::vector<typename Publication::id_type> const &parent_ids) {
-        if (exists(id))
-            throw PublicationAlreadyCreated();
-        for (auto parent : parent_ids) {
-            if (!exists(parent))
-                throw PublicationNotFound();
+
+private:
+    // Marked entries keep their position, so the list stays sorted by the
+    // index with the mark cleared.
+    template <class Items>
+    static decltype(std::declval<Items &>().begin()) lower_bound(Items &items, std::uint32_t x) noexcept {
+        return std::lower_bound(items.begin(), items.end(), x, [](std::uint32_t entry, std::uint32_t x) {
+            return (entry & ~marked) < x;
+        });
+    }
+
+    std::pmr::vector<std::uint32_t> items;
+    std::size_t erasedCount = 0;
+};
+
+// Hashes anything viewable as a string through std::string_view, so that
+// std::string, std::string_view and const char * keys agree with each other.
+struct transparent_hash {
+    using is_transparent = void;
+
+    template <class K>
+    std::size_t operator()(K const &key) const {
+        if constexpr (std::is_convertible<K const &, std::string_view>::value)
+            return std::hash<std::string_view>()(key);
+        else
+            return std::hash<K>()(key);
+    }
+};
+
+// Linear probing over a power-of-two table. Hashes are cached in the slots,
+// so growing never rehashes keys, and an entry is erased through the handle
+// returned on insert without hashing or comparing keys again.
+template <class Key, class Value, class Hash, class Equal>
+class open_addressing_table {
+    enum : unsigned char { empty, full, erased };
+
+    struct slot {
+        std::size_t hash = 0;
+        Value value = Value();
+        unsigned char state = empty;
+        std::optional<Key> key;
+    };
+
+public:
+    struct handle {
+        std::size_t hash;
+        Value value;
+    };
+
+    open_addressing_table() = default;
+
+    explicit open_addressing_table(std::pmr::memory_resource *resource) : slots(resource) {}
+
+    template <class K>
+    Value const *find(K const &key) const {
+        if (slots.empty())
+            return nullptr;
+        std::size_t hash = mix(hasher(key));
+        for (std::size_t i = hash & mask();; i = (i + 1) & mask()) {
+            slot const &s = slots[i];
+            if (s.state == empty)
+                return nullptr;
+            if (s.state == full && s.hash == hash && equal(*s.key, key))
+                return &s.value;
         }
+    }
 
-        if(parent_ids.size() == 0) throw PublicationNotFound();
+    // The key must not be present yet. Strong guarantee.
+    handle insert(Key const &key, Value value) {
+        std::size_t hash = mix(hasher(key));
+        if ((count + erasedCount + 1) * 4 > slots.size() * 3)
+            rehash(count + 1);
+        std::size_t i = hash & mask();
+        while (slots[i].state == full)
+            i = (i + 1) & mask();
+        slot &s = slots[i];
+        s.key.emplace(key);
+        if (s.state == erased)
+            --erasedCount;
+        s.hash = hash;
+        s.value = value;
+        s.state = full;
+        ++count;
+        return handle {hash, value};
+    }
 
-        std::shared_ptr<Node> newNode = std::make_shared<Node>(id);
-        map[id] = newNode;
-        std::vector<std::shared_ptr<Node> > addedParents;
-        try {
-            for (auto parent : parent_ids) {
-                std::shared_ptr<Node> parentNode = map.at(parent).lock();
-                addedParents.push_back(parentNode);
-                parentNode -> children.insert(newNode);
-                newNode -> parents.insert(parentNode);
+    void erase(handle h) noexcept {
+        for (std::size_t i = h.hash & mask(); slots[i].state != empty; i = (i + 1) & mask()) {
+            slot &s = slots[i];
+            if (s.state == full && s.value == h.value) {
+                s.key.reset();
+                s.state = erased;
+                --count;
+                ++erasedCount;
+                return;
             }
-        } catch(...) {
-            for (auto addedParent : addedParents) {
-                addedParent -> children.erase(newNode);
-                newNode -> parents.erase(addedParent);
-            }
-            map.erase(id);
         }
     }
 
-    void add_citation(typename Publication::id_type const &child_id, typename Publication::id_type const &parent_id) {
-        if (!exists(child_id) || !exists(parent_id))
-            throw PublicationNotFound();
-        std::shared_ptr<Node> childNode = map.at(child_id).lock();
-        std::shared_ptr<Node> parentNodeLocked = map.at(parent_id).lock();
-        auto result1 = childNode -> parents.insert(parentNodeLocked);
-        try {
-            parentNodeLocked -> children.insert(childNode);
-        } catch(...) {
-            if (result1.second)
-                childNode -> parents.erase(parentNodeLocked);
-            throw;
+    std::size_t size() const noexcept {
+        return count;
+    }
+
+    void reserve(std::size_t entries) {
+        if ((entries + erasedCount) * 4 > slots.size() * 3)
+            rehash(entries);
+    }
+
+    void swap(open_addressing_table &other) noexcept {
+        slots.swap(other.slots);
+        std::swap(count, other.count);
+        std::swap(erasedCount, other.erasedCount);
+    }
+
+private:
+    std::pmr::vector<slot> slots;
+    std::size_t count = 0;
+    std::size_t erasedCount = 0;
+    Hash hasher;
+    Equal equal;
+
+    static std::size_t mix(std::size_t hash) noexcept {
+        std::uint64_t h = hash;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return std::size_t(h);
+    }
+
+    std::size_t mask() const noexcept {
+        return slots.size() - 1;
+    }
+
+    void rehash(std::size_t entries) {
+        std::size_t capacity = 8;
+        while (capacity < 2 * entries)
+            capacity *= 2;
+        std::pmr::vector<slot> fresh(capacity, slots.get_allocator());
+        for (auto &s : slots) {
+            if (s.state != full)
+                continue;
+            std::size_t i = s.hash & (capacity - 1);
+            while (fresh[i].state == full)
+                i = (i + 1) & (capacity - 1);
+            fresh[i].key.emplace(std::move_if_noexcept(*s.key));
+            fresh[i].hash = s.hash;
+            fresh[i].value = s.value;
+            fresh[i].state = full;
         }
+        slots.swap(fresh);
+        erasedCount = 0;
+    }
+};
+
+// Snapshot layout, version 2. All integers are in host byte order; byte_order
+// lets a reader on a different machine refuse the file. After the header come
+// six sections, each starting on an 8-byte boundary:
+//   id offsets       uint64[publications + 1]
+//   id bytes         char[id_bytes]
+//   child offsets    uint64[publications + 1]
+//   children         uint32[citations]
+//   parent offsets   uint64[publications + 1]
+//   parents          uint32[citations]
+// Publications are numbered by ascending id, so a reader can binary search the
+// id table, and neighbours are listed by number. checksum covers every byte
+// after the header; version 1 files left it zero and are read unchecked.
+struct snapshot_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t publications;
+    std::uint64_t citations;
+    std::uint64_t id_bytes;
+    std::uint32_t root;
+    std::uint32_t checksum;
+};
 
+static_assert(sizeof(snapshot_header) == 48, "snapshot header must not contain padding");
 
+constexpr char snapshot_magic[8] = {'C', 'I', 'T', 'G', 'R', 'A', 'P', 'H'};
+constexpr std::uint32_t snapshot_version = 2;
+constexpr std::uint32_t snapshot_byte_order = 0x01020304;
+
+inline std::uint64_t snapshot_align(std::uint64_t offset) noexcept {
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+// Fletcher-style sum, fed the bytes in file order in as many pieces as
+// convenient.
+class snapshot_checksum {
+public:
+    void add(void const *data, std::size_t size) noexcept {
+        auto bytes = static_cast<unsigned char const *>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            sum += bytes[i];
+            weighted += sum;
+        }
     }
 
-    void remove(typename Publication::id_type const &id) {
-        if (!exists(id))
-            throw PublicationNotFound();
-        if (id == root -> publication.get_id())
-            throw TriedToRemoveRoot();
-        std::shared_ptr<Node> myNode = map.at(id).lock();
-        for (auto parent : myNode -> parents) {
-            if (std::shared_ptr<Node> validParent = parent.lock()) {
-                validParent -> children.erase(myNode);
+    std::uint32_t value() const noexcept {
+        return std::uint32_t(weighted ^ (weighted >> 32)) ^ std::uint32_t(sum) * 0x9e3779b1u;
+    }
+
+private:
+    std::uint64_t sum = 0;
+    std::uint64_t weighted = 0;
+};
+
+struct snapshot_sections {
+    std::uint64_t id_offsets;
+    std::uint64_t ids;
+    std::uint64_t child_offsets;
+    std::uint64_t children;
+    std::uint64_t parent_offsets;
+    std::uint64_t parents;
+    std::uint64_t end;
+
+    explicit snapshot_sections(snapshot_header const &header) noexcept {
+        std::uint64_t offsetsSize = 8 * (header.publications + 1);
+        id_offsets = sizeof(snapshot_header);
+        ids = id_offsets + offsetsSize;
+        child_offsets = snapshot_align(ids + header.id_bytes);
+        children = child_offsets + offsetsSize;
+        parent_offsets = snapshot_align(children + 4 * header.citations);
+        parents = parent_offsets + offsetsSize;
+        end = snapshot_align(parents + 4 * header.citations);
+    }
+};
+
+// A whole file, read-only: mapped where the platform allows it, read into
+// memory otherwise.
+class mapped_file {
+public:
+    explicit mapped_file(std::string const &path) {
+#ifdef CITATION_GRAPH_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+        length = std::size_t(status.st_size);
+        if (length != 0) {
+            address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                int error = errno;
+                ::close(fd);
+                address = nullptr;
+                throw std::system_error(error, std::generic_category(), path);
             }
+        }
+        ::close(fd);
+#else
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), path);
+        char chunk[1 << 16];
+        for (std::size_t got; (got = std::fread(chunk, 1, sizeof(chunk), file.get())) > 0;)
+            buffer.insert(buffer.end(), chunk, chunk + got);
+        if (std::ferror(file.get()))
+            throw std::system_error(EIO, std::generic_category(), path);
+#endif
+    }
+
+    mapped_file(mapped_file &&other) noexcept {
+        swap(other);
+    }
+    mapped_file &operator=(mapped_file &&other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~mapped_file() {
+#ifdef CITATION_GRAPH_HAS_MMAP
+        if (address)
+            ::munmap(address, length);
+#endif
+    }
+
+    char const *data() const noexcept {
+#ifdef CITATION_GRAPH_HAS_MMAP
+        return static_cast<char const *>(address);
+#else
+        return buffer.data();
+#endif
+    }
+
+    std::size_t size() const noexcept {
+#ifdef CITATION_GRAPH_HAS_MMAP
+        return length;
+#else
+        return buffer.size();
+#endif
+    }
+
+    void swap(mapped_file &other) noexcept {
+#ifdef CITATION_GRAPH_HAS_MMAP
+        std::swap(address, other.address);
+        std::swap(length, other.length);
+#else
+        buffer.swap(other.buffer);
+#endif
+    }
+
+private:
+#ifdef CITATION_GRAPH_HAS_MMAP
+    void *address = nullptr;
+    std::size_t length = 0;
+#else
+    std::vector<char> buffer;
+#endif
+};
+
+} // namespace citation_graph_detail
+
+// Id index policies for CitationGraph. An index maps publication ids to arena
+// slots; lookups are templated so callers can search with any type the index
+// knows how to compare with id_type (e.g. const char * for std::string ids).
+// An index constructed with a memory resource keeps its storage there; swap
+// only indices that share one.
+
+// Ordered map; needs nothing but operator< on ids.
+struct OrderedIdIndex {
+    template <class Key, class Value>
+    class index {
+    public:
+        using handle = typename std::pmr::map<Key, Value, std::less<> >::iterator;
+
+        index() = default;
+
+        explicit index(std::pmr::memory_resource *resource) : entries(resource) {}
 
+        template <class K>
+        Value const *find(K const &key) const {
+            auto found = entries.find(key);
+            return found == entries.end() ? nullptr : &found -> second;
         }
+
+        handle insert(Key const &key, Value value) {
+            return entries.emplace(key, value).first;
+        }
+
+        void erase(handle h) noexcept {
+            entries.erase(h);
+        }
+
+        std::size_t size() const noexcept {
+            return entries.size();
+        }
+
+        void reserve(std::size_t) noexcept {}
+
+        void swap(index &other) noexcept {
+            entries.swap(other.entries);
+        }
+
+    private:
+        std::pmr::map<Key, Value, std::less<> > entries;
+    };
+};
+
+// Open-addressing hash table with average O(1), allocation-free lookups.
+template <class Hash = citation_graph_detail::transparent_hash, class Equal = std::equal_to<> >
+struct HashIdIndex {
+    template <class Key, class Value>
+    using index = citation_graph_detail::open_addressing_table<Key, Value, Hash, Equal>;
+};
+
+// Ids that are, or map onto, small non-negative integers. Integral ids are
+// their own position; specialize this for any other id type that has one.
+template <class Id, class Enable = void>
+struct CitationDenseId {
+    static constexpr bool enabled = false;
+};
+
+template <class Id>
+struct CitationDenseId<Id, std::enable_if_t<std::is_integral<Id>::value> > {
+    static constexpr bool enabled = true;
+
+    // Negative ids wrap around to positions too large to be stored densely.
+    static std::uint64_t position(Id id) noexcept {
+        return std::uint64_t(id);
+    }
+};
+
+namespace citation_graph_detail {
+
+// A vector indexed by id position, for O(1) lookups without hashing or
+// comparing ids. The vector only grows while it stays at least half full;
+// ids beyond it go to a hash table instead, so a few huge or negative ids
+// cost no more than they would anywhere else.
+template <class Key, class Value>
+class dense_table {
+    using spill_table = open_addressing_table<Key, Value, transparent_hash, std::equal_to<> >;
+    static constexpr Value absent = ~Value(0);
+
+public:
+    struct handle {
+        std::uint64_t position;
+        typename spill_table::handle spilled;
+        bool dense;
+    };
+
+    dense_table() = default;
+
+    explicit dense_table(std::pmr::memory_resource *resource) : slots(resource), spill(resource) {}
+
+    Value const *find(Key const &key) const {
+        std::uint64_t position = CitationDenseId<Key>::position(key);
+        if (position < slots.size() && slots[position] != absent)
+            return &slots[position];
+        // The dense range may have grown over a key spilled before.
+        return spill.size() != 0 ? spill.find(key) : nullptr;
     }
 
+    // The key must not be present yet. Strong guarantee.
+    handle insert(Key const &key, Value value) {
+        std::uint64_t position = CitationDenseId<Key>::position(key);
+        std::uint64_t limit = std::max<std::uint64_t>(64, 2 * (count + 1));
+        if (position >= slots.size() && position < limit)
+            slots.resize(std::size_t(std::min(limit, std::max<std::uint64_t>(position + 1, 2 * slots.size()))),
+                         absent);
+        if (position < slots.size()) {
+            slots[position] = value;
+            ++count;
+            return handle {position, {}, true};
+        }
+        return handle {position, spill.insert(key, value), false};
+    }
+
+    void erase(handle h) noexcept {
+        if (h.dense) {
+            slots[h.position] = absent;
+            --count;
+        } else {
+            spill.erase(h.spilled);
+        }
+    }
+
+    std::size_t size() const noexcept {
+        return count + spill.size();
+    }
+
+    void reserve(std::size_t) noexcept {}
+
+    void swap(dense_table &other) noexcept {
+        slots.swap(other.slots);
+        spill.swap(other.spill);
+        std::swap(count, other.count);
+    }
+
+private:
+    std::pmr::vector<Value> slots;
+    spill_table spill;
+    std::size_t count = 0;
+};
+
+} // namespace citation_graph_detail
+
+// Direct-indexed by CitationDenseId position: O(1) lookups that touch one
+// vector element. Best for ids numbered from 0 with few gaps.
+struct DenseIdIndex {
+    template <class Key, class Value>
+    using index = citation_graph_detail::dense_table<Key, Value>;
+};
+
+// What a graph uses unless told otherwise: DenseIdIndex for dense ids,
+// OrderedIdIndex for everything else.
+template <class Id>
+using DefaultIdIndex = std::conditional_t<CitationDenseId<Id>::enabled, DenseIdIndex, OrderedIdIndex>;
+
+// What CitationGraph::stats() reports. Counters stay zero under
+// NoCitationStats; the publication counts are always filled in.
+struct CitationGraphStats {
+    // Id index searches; handle-based access does not count.
+    std::uint64_t lookups = 0;
+    // Growths of adjacency lists and of the topological order.
+    std::uint64_t allocations = 0;
+    std::uint64_t edge_inserts = 0;
+    std::uint64_t edge_erases = 0;
+    std::uint64_t removals = 0;
+    std::uint64_t removed_publications = 0;
+    // cascade_lengths[i] counts removals that took [2^i, 2^(i + 1))
+    // publications with them.
+    std::array<std::uint64_t, 32> cascade_lengths {};
+    std::size_t live_publications = 0;
+    std::size_t free_slots = 0;
+};
+
+// Instrumentation policies for CitationGraph. Every hook of NoCitationStats
+// is an empty inline function, so a graph without instrumentation compiles
+// to the same code as before.
+struct NoCitationStats {
+    struct counters {
+        void lookup() const noexcept {}
+        void allocation() const noexcept {}
+        void edges_inserted(std::size_t) const noexcept {}
+        void edges_erased(std::size_t) const noexcept {}
+        void cascade(std::size_t) const noexcept {}
+        void read(CitationGraphStats &) const noexcept {}
+        void assign(counters const &) noexcept {}
+        void swap(counters &) noexcept {}
+    };
+};
+
+// Relaxed atomic counters, so that const queries running on several threads
+// at once (see ConcurrentCitationGraph) may all count.
+struct CountingCitationStats {
+    class counters {
+    public:
+        void lookup() const noexcept {
+            bump(lookups);
+        }
+        void allocation() const noexcept {
+            bump(allocations);
+        }
+        void edges_inserted(std::size_t count) const noexcept {
+            bump(edgeInserts, count);
+        }
+        void edges_erased(std::size_t count) const noexcept {
+            bump(edgeErases, count);
+        }
+        void cascade(std::size_t length) const noexcept {
+            bump(removals);
+            bump(removedPublications, length);
+            std::size_t bucket = 0;
+            while (bucket + 1 < cascadeLengths.size() && (length >> (bucket + 1)) != 0)
+                ++bucket;
+            bump(cascadeLengths[bucket]);
+        }
+
+        void read(CitationGraphStats &out) const noexcept {
+            out.lookups = lookups.load(std::memory_order_relaxed);
+            out.allocations = allocations.load(std::memory_order_relaxed);
+            out.edge_inserts = edgeInserts.load(std::memory_order_relaxed);
+            out.edge_erases = edgeErases.load(std::memory_order_relaxed);
+            out.removals = removals.load(std::memory_order_relaxed);
+            out.removed_publications = removedPublications.load(std::memory_order_relaxed);
+            for (std::size_t i = 0; i < cascadeLengths.size(); ++i)
+                out.cascade_lengths[i] = cascadeLengths[i].load(std::memory_order_relaxed);
+        }
+
+        void assign(counters const &other) noexcept {
+            copy(lookups, other.lookups);
+            copy(allocations, other.allocations);
+            copy(edgeInserts, other.edgeInserts);
+            copy(edgeErases, other.edgeErases);
+            copy(removals, other.removals);
+            copy(removedPublications, other.removedPublications);
+            for (std::size_t i = 0; i < cascadeLengths.size(); ++i)
+                copy(cascadeLengths[i], other.cascadeLengths[i]);
+        }
+
+        void swap(counters &other) noexcept {
+            exchange(lookups, other.lookups);
+            exchange(allocations, other.allocations);
+            exchange(edgeInserts, other.edgeInserts);
+            exchange(edgeErases, other.edgeErases);
+            exchange(removals, other.removals);
+            exchange(removedPublications, other.removedPublications);
+            for (std::size_t i = 0; i < cascadeLengths.size(); ++i)
+                exchange(cascadeLengths[i], other.cascadeLengths[i]);
+        }
+
+    private:
+        using counter = std::atomic<std::uint64_t>;
+
+        static void bump(counter &c, std::uint64_t by = 1) noexcept {
+            c.fetch_add(by, std::memory_order_relaxed);
+        }
+
+        static void copy(counter &to, counter const &from) noexcept {
+            to.store(from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        static void exchange(counter &a, counter &b) noexcept {
+            a.store(b.exchange(a.load(std::memory_order_relaxed), std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+        }
+
+        mutable counter lookups {0};
+        mutable counter allocations {0};
+        mutable counter edgeInserts {0};
+        mutable counter edgeErases {0};
+        mutable counter removals {0};
+        mutable counter removedPublications {0};
+        mutable std::array<counter, 32> cascadeLengths {};
+    };
+};
+
+template <class Publication>
+class MappedCitationGraph;
+
+template <class Publication, class IndexPolicy, class StatsPolicy>
+class ConcurrentCitationGraph;
+
+// A graph frozen into compressed sparse rows, for whole-graph computations.
+// Publications are numbered 0..ids.size() - 1 in topological order, so every
+// parent comes before its children; publication i's children are
+// children[child_offsets[i] .. child_offsets[i + 1]), sorted, and likewise
+// for parents.
+template <class Id>
+struct CompressedCitationGraph {
+    std::vector<Id> ids;
+    std::vector<std::uint64_t> child_offsets;
+    std::vector<std::uint32_t> children;
+    std::vector<std::uint64_t> parent_offsets;
+    std::vector<std::uint32_t> parents;
+};
+
+template <class Publication, class IndexPolicy = DefaultIdIndex<typename Publication::id_type>,
+          class StatsPolicy = NoCitationStats>
+class CitationGraph {
+
+public:
+    struct MemoryStats {
+        std::size_t live_publications;
+        std::size_t dead_index_entries;
+        std::size_t free_slots;
+        std::size_t arena_slots;
+        std::size_t citations;
+        // Removed, but not reclaimed yet; see defer_reclamation.
+        std::size_t retired_publications;
+    };
+
+    // Names one publication for as long as it exists and reaches it without
+    // going through the id index. A handle to a removed publication is
+    // rejected with PublicationNotFound, even after its slot has been reused.
+    class NodeHandle {
+    public:
+        NodeHandle() noexcept = default;
+
+        explicit operator bool() const noexcept {
+            return generation != 0;
+        }
+        bool operator==(NodeHandle const &other) const noexcept {
+            return index == other.index && generation == other.generation;
+        }
+        bool operator!=(NodeHandle const &other) const noexcept {
+            return !(*this == other);
+        }
+
+    private:
+        friend class CitationGraph;
+        NodeHandle(std::uint32_t index, std::uint32_t generation) noexcept
+                : index(index), generation(generation) {}
+
+        std::uint32_t index = 0;
+        std::uint32_t generation = 0;
+    };
+
+private:
+    // Publishes versions from the working copy's own structures.
+    template <class, class, class>
+    friend class ConcurrentCitationGraph;
+
+    using id_type = typename Publication::id_type;
+    using index_type = std::uint32_t;
+    using id_index = typename IndexPolicy::template index<id_type, index_type>;
+
+    template <class Key>
+    using if_foreign_key = std::enable_if_t<!std::is_same<std::decay_t<Key>, id_type>::value>;
+
+    using adjacency = citation_graph_detail::adjacency_list;
+
+    static constexpr bool borrows_id =
+            std::is_same<decltype(std::declval<Publication const &>().get_id()), id_type const &>::value
+            && noexcept(std::declval<Publication const &>().get_id());
+
+    class Node {
+    public:
+        Node() = default;
+
+        explicit Node(std::pmr::memory_resource *resource) noexcept : children(resource), parents(resource) {}
+
+        // The id is read from the publication when get_id() returns a
+        // reference to one it keeps, without throwing. Otherwise the node
+        // keeps a copy, so that views can hand out references: one more
+        // id_type, and whatever that allocates, per publication.
+        id_type const &id() const noexcept {
+            if constexpr (borrows_id)
+                return publication -> get_id();
+            else
+                return *idCopy;
+        }
+
+        void emplace(id_type const &key) {
+            publication.emplace(key);
+            if constexpr (!borrows_id)
+                idCopy.emplace(key);
+        }
+
+        std::optional<Publication> publication;
+        typename id_index::handle entry;
+        std::uint32_t generation = 1;
+        std::uint32_t rank = 0;
+        // Removed, but kept whole until the open transaction ends or, if
+        // retired, until reclaimed.
+        bool parked = false;
+        bool retired = false;
+        std::conditional_t<borrows_id, citation_graph_detail::no_id_copy, std::optional<id_type> > idCopy;
+        adjacency children;
+        adjacency parents;
+
+        void clear() noexcept {
+            publication.reset();
+            parked = false;
+            retired = false;
+            if constexpr (!borrows_id)
+                idCopy.reset();
+            if (++generation == 0)
+                generation = 1;
+            adjacency(children.get_allocator()).swap(children);
+            adjacency(parents.get_allocator()).swap(parents);
+        }
+    };
+
+    index_type root = 0;
+    citation_graph_detail::chunked_arena<Node> nodes;
+    // Boxed, so that moving a graph never swaps containers that allocate
+    // from different memory resources.
+    std::unique_ptr<id_index> map;
+    std::vector<index_type> freeSlots;
+    std::size_t citationCount = 0;
+    mutable citation_graph_detail::visit_marks marks;
+    // Surviving parents by slot while a removal cascade runs, untouched
+    // otherwise.
+    static constexpr std::uint32_t untouched = ~std::uint32_t(0);
+    std::vector<std::uint32_t> survivingParents;
+
+    // Topological order: order[node.rank] is the node's slot, or hole once it
+    // has been removed. Parents always rank below their children.
+    static constexpr index_type hole = ~index_type(0);
+    std::vector<index_type> order;
+    std::size_t orderHoles = 0;
+
+    // Transitive descendant counts by slot, kept while influence tracking is on.
+    bool trackInfluence = false;
+    mutable bool influenceStale = true;
+    mutable std::vector<std::size_t> influenceCache;
+    // The counts as a transaction found them, for rollback to put back.
+    bool influenceSaved = false;
+    std::vector<std::size_t> savedInfluence;
+    // Per-slot reach masks for count_reached(), grown on demand.
+    mutable std::vector<std::uint64_t> reachMasks;
+
+    // Live publications by citation count, kept while citation tracking is on.
+    bool trackCitations = false;
+    mutable bool citationsStale = true;
+    mutable citation_graph_detail::ranked_counts citationRanking;
+
+    // GRAIL-style interval labels for is_descendant(): labelCount pairs
+    // [lowest, post] per slot, one per randomized DFS from the root. If a
+    // reaches d, each label of d lies within the matching label of a.
+    std::size_t labelCount = 0;
+    mutable bool labelsStale = true;
+    mutable std::vector<std::uint32_t> labels;
+
+    // Undo journal of the open transaction. Created publications are undone
+    // by unlinking them from whatever they cite or are cited by; removed ones
+    // are parked[first, second) and get their citations back.
+    struct journal_entry {
+        enum { created, linked, removed } kind;
+        index_type first;
+        index_type second;
+        // created: appended to order; removed: left holes in it.
+        bool ordered;
+    };
+    bool transaction = false;
+    // Set once a transaction makes order unreliable; commit recomputes it.
+    bool orderStale = false;
+    std::vector<journal_entry> journal;
+    std::vector<index_type> parked;
+
+    // Deferred reclamation: removed publications are retired, hidden like
+    // parked ones, and freed a few at a time by later mutations. Entries are
+    // (slot, generation); one whose slot was freed early is skipped.
+    bool deferReclamation = false;
+    std::size_t reclaimPerCall = 0;
+    std::vector<std::pair<index_type, std::uint32_t> > retired;
+    std::size_t retiredCount = 0;
+
+    typename StatsPolicy::counters stats_;
+
+    template <class Key>
+    index_type const *lookup(Key const &id) const {
+        stats_.lookup();
+        index_type const *found = map -> find(id);
+        if (found && any_hidden() && nodes[*found].parked)
+            return nullptr;
+        return found;
+    }
+
+    bool any_hidden() const noexcept {
+        return !parked.empty() || retiredCount != 0;
+    }
+
+    std::size_t live_count() const noexcept {
+        return nodes.size() - freeSlots.size() - parked.size() - retiredCount;
+    }
+
+    // reserve_one/reserve_more, counting the reallocations.
+    template <class Vector>
+    void make_room(Vector &v, std::size_t extra = 1) {
+        if (v.capacity() - v.size() < extra) {
+            if (extra == 1)
+                citation_graph_detail::reserve_one(v);
+            else
+                citation_graph_detail::reserve_more(v, extra);
+            stats_.allocation();
+        }
+    }
+
+    template <class Key>
+    index_type locate(Key const &id) const {
+        index_type const *found = lookup(id);
+        if (!found)
+            throw PublicationNotFound();
+        return *found;
+    }
+
+    index_type locate(NodeHandle handle) const {
+        if (!holds(handle))
+            throw PublicationNotFound();
+        return handle.index;
+    }
+
+    bool holds(NodeHandle handle) const noexcept {
+        return handle.index < nodes.size() && nodes[handle.index].publication && !nodes[handle.index].parked
+                && nodes[handle.index].generation == handle.generation;
+    }
+
+    index_type checked(index_type key) const {
+        if (!contains_key(key))
+            throw PublicationNotFound();
+        return key;
+    }
+
+    NodeHandle handle_of(index_type index) const noexcept {
+        return NodeHandle(index, nodes[index].generation);
+    }
+
+    template <class Indices>
+    std::vector<id_type> ids_of(Indices const &indices) const {
+        std::vector<id_type> result;
+        result.reserve(indices.size());
+        for (auto index : indices)
+            result.push_back(nodes[index].id());
+        return result;
+    }
+
+    // Takes a slot, preferably a free one, and makes the new publication
+    // findable. Strong guarantee.
+    index_type emplace_node(id_type const &id) {
+        // A parked id keeps its index entry until the transaction ends.
+        if (any_hidden() && map -> find(id))
+            throw PublicationAlreadyCreated();
+        bool reused = !freeSlots.empty();
+        if (!reused && nodes.size() >= adjacency::marked)
+            throw std::length_error("CitationGraph");
+        index_type slot = reused ? freeSlots.back() : index_type(nodes.grow());
+        Node &newNode = nodes[slot];
+        try {
+            newNode.emplace(id);
+            newNode.entry = map -> insert(id, slot);
+        } catch (...) {
+            newNode.clear();
+            if (!reused)
+                nodes.shrink();
+            throw;
+        }
+        if (reused)
+            freeSlots.pop_back();
+        return slot;
+    }
+
+    // Gives back the index entry and the slot. freeSlots must have room.
+    void free_node(index_type slot) noexcept {
+        map -> erase(nodes[slot].entry);
+        nodes[slot].clear();
+        freeSlots.push_back(slot);
+    }
+
+    // retired must have room.
+    void retire(index_type slot) noexcept {
+        nodes[slot].parked = true;
+        nodes[slot].retired = true;
+        retired.emplace_back(slot, nodes[slot].generation);
+        ++retiredCount;
+    }
+
+    // Frees the retired publication with this id, if there is one, so that
+    // the id can be used again.
+    void release_retired(id_type const &id) {
+        if (retiredCount == 0)
+            return;
+        index_type const *found = map -> find(id);
+        if (found && nodes[*found].retired) {
+            make_room(freeSlots);
+            --retiredCount;
+            free_node(*found);
+        }
+    }
+
+    // Frees up to count retired publications; returns how many it freed.
+    std::size_t reclaim(std::size_t count) {
+        std::size_t freed = 0;
+        while (freed < count && !retired.empty()) {
+            auto next = retired.back();
+            Node &node = nodes[next.first];
+            if (node.retired && node.generation == next.second) {
+                make_room(freeSlots);
+                --retiredCount;
+                free_node(next.first);
+                ++freed;
+            }
+            retired.pop_back();
+        }
+        return freed;
+    }
+
+    void reclaim_slice() {
+        if (!retired.empty())
+            reclaim(reclaimPerCall);
+    }
+
+    // Undoes the most recent emplace_node() that is still in effect.
+    void discard_node(index_type slot, bool reused) noexcept {
+        map -> erase(nodes[slot].entry);
+        nodes[slot].clear();
+        if (reused)
+            freeSlots.push_back(slot);
+        else
+            nodes.shrink();
+    }
+
+    // Calls visit(key, first, last) for each run of edges sharing a first element.
+    template <class Edge, class Visitor>
+    static void for_each_group(std::vector<Edge> const &edges, Visitor &&visit) {
+        for (auto first = edges.begin(); first != edges.end();) {
+            auto last = first;
+            while (last != edges.end() && last -> first == first -> first)
+                ++last;
+            visit(first -> first, first, last);
+            first = last;
+        }
+    }
+
+    NodeHandle insert_node(id_type const &id, std::vector<index_type> parents) {
+        if (parents.empty()) throw PublicationNotFound();
+        reclaim_slice();
+        release_retired(id);
+
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+        for (auto parent : parents)
+            make_room(nodes[parent].children);
+        make_room(order);
+        if (transaction)
+            make_room(journal);
+
+        // A new leaf adds one descendant to each of its ancestors, unless
+        // they are too many to walk; then the counts go stale instead.
+        std::optional<std::vector<index_type> > ancestors;
+        bool updateInfluence = trackInfluence && !influenceStale;
+        if (updateInfluence) {
+            ancestors = walk(parents, &Node::parents, influence_budget());
+            updateInfluence = ancestors.has_value();
+            if (updateInfluence)
+                influenceCache.resize(nodes.size() + 1);
+        }
+        bool updateLabels = labelCount != 0 && !labelsStale;
+        if (updateLabels)
+            labels.resize(std::max(labels.size(), (nodes.size() + 1) * 2 * labelCount));
+        bool updateCitations = trackCitations && !citationsStale;
+        if (updateCitations) {
+            std::size_t most = 0;
+            for (auto parent : parents)
+                most = std::max(most, nodes[parent].children.size() + 1);
+            citationRanking.reserve(nodes.size() + 1, most);
+        }
+        adjacency cited(parents.begin(), parents.end(), nodes.resource());
+
+        bool reused = !freeSlots.empty();
+        index_type slot = emplace_node(id);
+        Node &newNode = nodes[slot];
+        newNode.rank = std::uint32_t(order.size());
+        order.push_back(slot);
+        citationCount += parents.size();
+        stats_.edges_inserted(parents.size());
+        newNode.parents = std::move(cited);
+        for (auto parent : newNode.parents)
+            nodes[parent].children.insert(slot);
+        if (updateInfluence) {
+            influenceCache[slot] = 0;
+            for (auto ancestor : *ancestors)
+                ++influenceCache[ancestor];
+        } else if (trackInfluence) {
+            influenceStale = true;
+        }
+        if (updateLabels)
+            label_leaf(slot);
+        if (updateCitations) {
+            citationRanking.insert(slot);
+            for (auto parent : newNode.parents)
+                citationRanking.raise(parent);
+        }
+        if (transaction)
+            journal.push_back({journal_entry::created, slot, index_type(reused), true});
+        return handle_of(slot);
+    }
+
+    // Everything reachable from start along list (children or parents),
+    // start included.
+    std::vector<index_type> walk(std::vector<index_type> const &start, adjacency Node::*list) const {
+        return *walk(start, list, std::numeric_limits<std::size_t>::max());
+    }
+
+    // The same, or nothing once it takes more than budget steps.
+    std::optional<std::vector<index_type> > walk(std::vector<index_type> const &start, adjacency Node::*list,
+                                                 std::size_t budget) const {
+        marks.reset(nodes.size());
+        std::vector<index_type> reached;
+        for (auto slot : start) {
+            if (marks.visit(slot))
+                reached.push_back(slot);
+        }
+        std::size_t steps = 0;
+        for (std::size_t next = 0; next < reached.size(); ++next) {
+            adjacency const &neighbors = nodes[reached[next]].*list;
+            steps += 1 + neighbors.size();
+            if (steps > budget)
+                return std::nullopt;
+            for (auto neighbor : neighbors) {
+                if (marks.visit(neighbor))
+                    reached.push_back(neighbor);
+            }
+        }
+        return reached;
+    }
+
+    std::vector<index_type> topological_slots() const {
+        if (orderStale)
+            return kahn_order();
+        std::vector<index_type> result;
+        result.reserve(order.size() - orderHoles);
+        for (auto slot : order) {
+            if (slot != hole)
+                result.push_back(slot);
+        }
+        return result;
+    }
+
+    // Kahn's algorithm from the root; extraParents(slot) and
+    // forEachExtraChild(slot, f) describe citations not linked yet. Throws
+    // CitationCycle unless every live publication gets ordered, each once.
+    // The root starts the order, so a citation of the root is a cycle.
+    template <class ExtraParents, class ForEachExtraChild>
+    std::vector<index_type> kahn_order(ExtraParents &&extraParents, ForEachExtraChild &&forEachExtraChild) const {
+        if (!nodes[root].parents.empty() || extraParents(root) != 0)
+            throw CitationCycle();
+        std::vector<index_type> result {root};
+        result.reserve(live_count());
+        std::vector<std::size_t> seenParents(nodes.size());
+        auto reach = [&](index_type child) {
+            if (++seenParents[child] == nodes[child].parents.size() + extraParents(child))
+                result.push_back(child);
+        };
+        for (std::size_t next = 0; next < result.size(); ++next) {
+            index_type slot = result[next];
+            for (auto child : nodes[slot].children)
+                reach(child);
+            forEachExtraChild(slot, reach);
+        }
+        if (result.size() != live_count())
+            throw CitationCycle();
+        return result;
+    }
+
+    std::vector<index_type> kahn_order() const {
+        return kahn_order([](index_type) { return std::size_t(0); }, [](index_type, auto &&) {});
+    }
+
+    void compact_order() noexcept {
+        std::size_t kept = 0;
+        for (auto slot : order) {
+            if (slot != hole) {
+                nodes[slot].rank = std::uint32_t(kept);
+                order[kept++] = slot;
+            }
+        }
+        order.resize(kept);
+        orderHoles = 0;
+    }
+
+    // Pearce-Kelly: a citation that goes against the current order can only
+    // disturb publications ranked between its two ends. Collects those reached
+    // from child downwards and from parent upwards, throwing CitationCycle if
+    // child already reaches parent. Allocates, but changes nothing.
+    void affected_region(index_type child, index_type parent,
+                         std::vector<index_type> &forward, std::vector<index_type> &backward) const {
+        std::uint32_t lower = nodes[child].rank;
+        std::uint32_t upper = nodes[parent].rank;
+        auto collect = [this](index_type start, adjacency Node::*list, auto inRegion) {
+            std::vector<index_type> reached {start};
+            marks.reset(nodes.size());
+            marks.visit(start);
+            for (std::size_t next = 0; next < reached.size(); ++next) {
+                for (auto neighbor : nodes[reached[next]].*list) {
+                    if (inRegion(nodes[neighbor].rank) && marks.visit(neighbor))
+                        reached.push_back(neighbor);
+                }
+            }
+            return reached;
+        };
+        forward = collect(child, &Node::children, [upper](std::uint32_t rank) { return rank <= upper; });
+        if (std::find(forward.begin(), forward.end(), parent) != forward.end())
+            throw CitationCycle();
+        backward = collect(parent, &Node::parents, [lower](std::uint32_t rank) { return rank > lower; });
+    }
+
+    // Gives the backward region the lowest of the freed ranks, keeping the
+    // relative order inside each region. ranks must have room for both.
+    void reorder(std::vector<index_type> &forward, std::vector<index_type> &backward,
+                 std::vector<std::uint32_t> &ranks) noexcept {
+        auto byRank = [this](index_type a, index_type b) {
+            return nodes[a].rank < nodes[b].rank;
+        };
+        std::sort(forward.begin(), forward.end(), byRank);
+        std::sort(backward.begin(), backward.end(), byRank);
+        for (auto slot : backward)
+            ranks.push_back(nodes[slot].rank);
+        for (auto slot : forward)
+            ranks.push_back(nodes[slot].rank);
+        std::sort(ranks.begin(), ranks.end());
+        std::size_t next = 0;
+        for (auto slot : backward) {
+            nodes[slot].rank = ranks[next++];
+            order[nodes[slot].rank] = slot;
+        }
+        for (auto slot : forward) {
+            nodes[slot].rank = ranks[next++];
+            order[nodes[slot].rank] = slot;
+        }
+    }
+
+    // Exact descendant counts by slot. Targets are taken 64 at a time in
+    // topological order, and one reverse sweep ORs 64-bit reach masks from
+    // children into parents, so each sweep settles 64 targets at once.
+    std::vector<std::size_t> count_descendants() const {
+        std::vector<index_type> order = topological_slots();
+        std::vector<std::size_t> counts(nodes.size());
+        std::vector<std::uint64_t> reach(nodes.size());
+        for (std::size_t first = 0; first < order.size(); first += 64) {
+            std::size_t last = std::min(order.size(), first + 64);
+            for (std::size_t i = last; i-- > 0;) {
+                index_type slot = order[i];
+                bool target = i >= first;
+                std::uint64_t mask = target ? std::uint64_t(1) << (i - first) : 0;
+                for (auto child : nodes[slot].children)
+                    mask |= reach[child];
+                reach[slot] = mask;
+                counts[slot] += citation_graph_detail::popcount64(mask) - (target ? 1 : 0);
+            }
+        }
+        return counts;
+    }
+
+    // For each source, how many of targets it reaches, going around every
+    // slot for which skip() holds. Sources and targets must not overlap. As
+    // in count_descendants, targets are taken 64 at a time, but only their
+    // ancestors are swept, in reverse rank order, so the order must be
+    // valid. Gives up, returning nothing, once that would take more than
+    // budget steps.
+    template <class Skip>
+    std::optional<std::vector<std::size_t> > count_reached(std::vector<index_type> const &sources,
+                                                          std::vector<index_type> const &targets,
+                                                          Skip &&skip, std::size_t budget) const {
+        std::vector<index_type> region;
+        marks.reset(nodes.size());
+        for (auto target : targets) {
+            if (marks.visit(target))
+                region.push_back(target);
+        }
+        std::size_t steps = 0;
+        for (std::size_t next = 0; next < region.size(); ++next) {
+            Node const &node = nodes[region[next]];
+            steps += 1 + node.parents.size() + node.children.size();
+            if (steps > budget)
+                return std::nullopt;
+            for (auto parent : node.parents) {
+                if (!skip(parent) && marks.visit(parent))
+                    region.push_back(parent);
+            }
+        }
+        if ((targets.size() + 63) / 64 * steps > budget)
+            return std::nullopt;
+        std::sort(region.begin(), region.end(), [this](index_type a, index_type b) {
+            return nodes[a].rank > nodes[b].rank;
+        });
+        if (reachMasks.size() < nodes.size())
+            reachMasks.resize(nodes.size());
+        std::vector<std::size_t> counts(sources.size());
+        for (std::size_t first = 0; first < targets.size(); first += 64) {
+            for (auto slot : region)
+                reachMasks[slot] = 0;
+            for (std::size_t i = first; i < std::min(targets.size(), first + 64); ++i)
+                reachMasks[targets[i]] = std::uint64_t(1) << (i - first);
+            for (auto slot : region) {
+                std::uint64_t mask = reachMasks[slot];
+                for (auto child : nodes[slot].children) {
+                    if (marks.visited(child))
+                        mask |= reachMasks[child];
+                }
+                reachMasks[slot] = mask;
+            }
+            for (std::size_t k = 0; k < sources.size(); ++k) {
+                if (marks.visited(sources[k]))
+                    counts[k] += citation_graph_detail::popcount64(reachMasks[sources[k]]);
+            }
+        }
+        return counts;
+    }
+
+    // Keeping influence counts current by deltas may cost what a full
+    // recount spends per publication, a 64th of a pass over the graph, with
+    // some slack for small graphs; beyond that they are left stale.
+    std::size_t influence_budget() const noexcept {
+        return std::max<std::size_t>(4096, (live_count() + citationCount) / 64);
+    }
+
+    std::uint32_t *label(index_type slot, std::size_t traversal) const noexcept {
+        return &labels[(slot * labelCount + traversal) * 2];
+    }
+
+    // Whether every label of inner lies within the matching one of outer,
+    // as it must if outer reaches inner.
+    bool labels_within(index_type inner, index_type outer) const noexcept {
+        for (std::size_t traversal = 0; traversal < labelCount; ++traversal) {
+            std::uint32_t const *in = label(inner, traversal);
+            std::uint32_t const *out = label(outer, traversal);
+            if (in[0] < out[0] || in[1] > out[1])
+                return false;
+        }
+        return true;
+    }
+
+    // One post-order DFS from the root per label, each visiting children
+    // from a different pseudo-random starting point. A label is the
+    // publication's post number together with the lowest one below it.
+    void refresh_labels() const {
+        if (!labelsStale)
+            return;
+        std::vector<std::uint32_t> fresh(nodes.size() * 2 * labelCount);
+        std::vector<std::pair<index_type, std::size_t> > path;
+        for (std::size_t traversal = 0; traversal < labelCount; ++traversal) {
+            auto at = [&](index_type slot) {
+                return &fresh[(slot * labelCount + traversal) * 2];
+            };
+            std::uint32_t post = 0;
+            marks.reset(nodes.size());
+            marks.visit(root);
+            at(root)[0] = ~std::uint32_t(0);
+            path.assign(1, std::make_pair(root, std::size_t(0)));
+            while (!path.empty()) {
+                index_type slot = path.back().first;
+                auto const &children = nodes[slot].children.entries();
+                std::uint32_t *current = at(slot);
+                if (path.back().second < children.size()) {
+                    std::size_t offset = traversal == 0 ? 0
+                            : std::size_t(citation_graph_detail::mix64(slot * labelCount + traversal));
+                    index_type child = children[(path.back().second++ + offset) % children.size()];
+                    if (child & adjacency::marked) {
+                        continue;
+                    } else if (marks.visit(child)) {
+                        at(child)[0] = ~std::uint32_t(0);
+                        path.emplace_back(child, 0);
+                    } else {
+                        current[0] = std::min(current[0], at(child)[0]);
+                    }
+                    continue;
+                }
+                current[1] = post++;
+                current[0] = std::min(current[0], current[1]);
+                path.pop_back();
+                if (!path.empty())
+                    at(path.back().first)[0] = std::min(at(path.back().first)[0], current[0]);
+            }
+        }
+        labels.swap(fresh);
+        labelsStale = false;
+    }
+
+    // A new leaf gets a point inside all of its parents' labels, if there is
+    // one; otherwise the labels are rebuilt on the next query.
+    void label_leaf(index_type slot) noexcept {
+        for (std::size_t traversal = 0; traversal < labelCount; ++traversal) {
+            std::uint32_t low = 0;
+            std::uint32_t high = ~std::uint32_t(0);
+            for (auto parent : nodes[slot].parents) {
+                low = std::max(low, label(parent, traversal)[0]);
+                high = std::min(high, label(parent, traversal)[1]);
+            }
+            if (low > high) {
+                labelsStale = true;
+                return;
+            }
+            label(slot, traversal)[0] = low;
+            label(slot, traversal)[1] = low;
+        }
+    }
+
+    // Exact. A publication can only reach those ranked after it, and with
+    // labels only those whose labels it contains, so the search skips
+    // everything else. Inside a transaction that broke the order, nothing is
+    // skipped.
+    bool reaches(index_type from, index_type to) const {
+        if (from == to)
+            return false;
+        bool pruned = !orderStale;
+        std::uint32_t limit = nodes[to].rank;
+        if (pruned && limit <= nodes[from].rank)
+            return false;
+        if (pruned && labelCount != 0) {
+            refresh_labels();
+            if (!labels_within(to, from))
+                return false;
+        }
+        std::vector<index_type> pending {from};
+        marks.reset(nodes.size());
+        marks.visit(from);
+        while (!pending.empty()) {
+            index_type slot = pending.back();
+            pending.pop_back();
+            for (auto child : nodes[slot].children) {
+                if (child == to)
+                    return true;
+                if ((!pruned || (nodes[child].rank < limit && (labelCount == 0 || labels_within(to, child))))
+                        && marks.visit(child))
+                    pending.push_back(child);
+            }
+        }
+        return false;
+    }
+
+    void refresh_influence() const {
+        if (influenceStale) {
+            influenceCache = count_descendants();
+            influenceStale = false;
+        }
+    }
+
+    void refresh_citations() const {
+        if (citationsStale) {
+            std::vector<index_type> live;
+            live.reserve(live_count());
+            for (index_type slot = 0; slot < nodes.size(); ++slot) {
+                if (nodes[slot].publication && !nodes[slot].parked)
+                    live.push_back(slot);
+            }
+            citationRanking.assign(nodes.size(), live, [this](index_type slot) {
+                return nodes[slot].children.size();
+            });
+            citationsStale = false;
+        }
+    }
+
+    void link(index_type child, index_type parent) {
+        reclaim_slice();
+        Node &childNode = nodes[child];
+        Node &parentNode = nodes[parent];
+        if (childNode.parents.contains(parent))
+            return;
+        std::vector<index_type> forward;
+        std::vector<index_type> backward;
+        std::vector<std::uint32_t> ranks;
+        bool againstOrder = parentNode.rank >= childNode.rank;
+        if (transaction) {
+            // Cycles are looked for once, at commit.
+            if (child == parent)
+                throw CitationCycle();
+            make_room(journal);
+        } else if (againstOrder) {
+            affected_region(child, parent, forward, backward);
+            ranks.reserve(forward.size() + backward.size());
+        }
+        // Parent and its ancestors gain whatever of child and its
+        // descendants they did not reach yet.
+        std::vector<index_type> gainers;
+        std::vector<index_type> cone;
+        std::optional<std::vector<std::size_t> > reached;
+        if (trackInfluence && !influenceStale && !transaction) {
+            auto below = walk({child}, &Node::children, influence_budget());
+            auto above = below ? walk({parent}, &Node::parents, influence_budget()) : std::nullopt;
+            if (above) {
+                cone = std::move(*below);
+                gainers = std::move(*above);
+                reached = count_reached(gainers, cone, [](index_type) { return false; }, influence_budget());
+            }
+        }
+        make_room(childNode.parents);
+        make_room(parentNode.children);
+        bool updateCitations = trackCitations && !citationsStale;
+        if (updateCitations)
+            citationRanking.reserve(nodes.size(), parentNode.children.size() + 1);
+        if (!forward.empty())
+            reorder(forward, backward, ranks);
+        childNode.parents.insert(parent);
+        parentNode.children.insert(child);
+        if (updateCitations)
+            citationRanking.raise(parent);
+        if (transaction) {
+            journal.push_back({journal_entry::linked, child, parent, false});
+            orderStale = orderStale || againstOrder;
+        }
+        ++citationCount;
+        stats_.edges_inserted(1);
+        if (reached) {
+            for (std::size_t k = 0; k < gainers.size(); ++k)
+                influenceCache[gainers[k]] += cone.size() - (*reached)[k];
+        } else {
+            influenceStale = true;
+        }
+        // Still valid if everything below child already fits under parent.
+        if (labelCount != 0 && !labelsStale && !labels_within(child, parent))
+            labelsStale = true;
+    }
+
+    // A publication survives as long as at least one of its parents does, so
+    // the removed set is found with a worklist that counts down surviving
+    // parents. Nothing recurses, however deep the citation chain. Each
+    // survivor then loses all of its removed neighbours at once: a few by
+    // binary search, many in one pass over its list, so cutting a hub off
+    // from much of its audience does not rescan the hub for every citation.
+    // Removed publications give back their index entry and their arena
+    // slot, at once or, with deferred reclamation, once retired and
+    // reclaimed.
+    std::size_t erase_cascade(std::vector<index_type> doomed) {
+        using edge = std::pair<index_type, index_type>;
+        reclaim_slice();
+        if (survivingParents.size() < nodes.size())
+            survivingParents.resize(nodes.size(), untouched);
+        for (auto victim : doomed)
+            survivingParents[victim] = 0;
+        std::vector<index_type> counted;
+        auto release = [&]() noexcept {
+            for (auto slot : doomed)
+                survivingParents[slot] = untouched;
+            for (auto slot : counted)
+                survivingParents[slot] = untouched;
+        };
+        auto isDoomed = [this](index_type slot) {
+            return survivingParents[slot] == 0;
+        };
+        // (survivor, removed neighbour) pairs.
+        std::vector<edge> lostChildren;
+        std::vector<edge> lostParents;
+        std::vector<index_type> losers;
+        std::optional<std::vector<std::size_t> > reachedBefore;
+        std::optional<std::vector<std::size_t> > reachedAfter;
+        try {
+            for (std::size_t next = 0; next < doomed.size(); ++next) {
+                for (auto child : nodes[doomed[next]].children) {
+                    std::uint32_t &counter = survivingParents[child];
+                    if (counter == untouched) {
+                        counted.push_back(child);
+                        counter = std::uint32_t(nodes[child].parents.size());
+                    }
+                    if (counter != 0 && --counter == 0)
+                        doomed.push_back(child);
+                }
+            }
+            for (auto dead : doomed) {
+                for (auto parent : nodes[dead].parents) {
+                    if (!isDoomed(parent))
+                        lostChildren.emplace_back(parent, dead);
+                }
+                for (auto child : nodes[dead].children) {
+                    if (!isDoomed(child))
+                        lostParents.emplace_back(child, dead);
+                }
+            }
+            std::sort(lostChildren.begin(), lostChildren.end());
+            std::sort(lostParents.begin(), lostParents.end());
+            // Ancestors lose the removed publications, and whatever below
+            // them they reached only through those.
+            auto above = trackInfluence && !influenceStale && !transaction
+                    ? walk(doomed, &Node::parents, influence_budget()) : std::nullopt;
+            auto below = above ? walk(doomed, &Node::children, influence_budget()) : std::nullopt;
+            if (below) {
+                losers = std::move(*above);
+                losers.erase(std::remove_if(losers.begin(), losers.end(), isDoomed), losers.end());
+                std::vector<index_type> &cone = *below;
+                reachedBefore = count_reached(losers, cone, [](index_type) { return false; }, influence_budget());
+                if (reachedBefore) {
+                    cone.erase(std::remove_if(cone.begin(), cone.end(), isDoomed), cone.end());
+                    reachedAfter = count_reached(losers, cone, isDoomed, influence_budget());
+                }
+            }
+            if (transaction) {
+                make_room(journal);
+                citation_graph_detail::reserve_more(parked, doomed.size());
+            } else if (deferReclamation) {
+                citation_graph_detail::reserve_more(retired, doomed.size());
+            } else {
+                citation_graph_detail::reserve_more(freeSlots, doomed.size());
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+        std::size_t citationsBefore = citationCount;
+        bool updateCitations = trackCitations && !citationsStale;
+
+        auto cut = [&](std::vector<edge> const &lost, adjacency Node::*list) noexcept {
+            for_each_group(lost, [&](index_type survivor, auto first, auto last) {
+                adjacency &neighbors = nodes[survivor].*list;
+                if (std::size_t(last - first) * 8 >= neighbors.size()) {
+                    neighbors.erase_if(isDoomed);
+                } else {
+                    for (; first != last; ++first)
+                        neighbors.erase(first -> second);
+                }
+            });
+        };
+        cut(lostChildren, &Node::children);
+        cut(lostParents, &Node::parents);
+        for (auto dead : doomed)
+            citationCount -= nodes[dead].parents.size();
+        citationCount -= lostParents.size();
+        if (updateCitations) {
+            for (auto const &lost : lostChildren)
+                citationRanking.lower(lost.first);
+            for (auto dead : doomed)
+                citationRanking.erase(dead);
+        }
+        release();
+        if (transaction) {
+            // Parked with their own citations intact, so that rollback can
+            // put them back and commit can free them.
+            index_type first = index_type(parked.size());
+            for (auto dead : doomed) {
+                nodes[dead].parked = true;
+                parked.push_back(dead);
+                if (!orderStale)
+                    order[nodes[dead].rank] = hole;
+            }
+            if (!orderStale)
+                orderHoles += doomed.size();
+            journal.push_back({journal_entry::removed, first, index_type(parked.size()), !orderStale});
+        } else {
+            for (auto dead : doomed) {
+                order[nodes[dead].rank] = hole;
+                if (deferReclamation)
+                    retire(dead);
+                else
+                    free_node(dead);
+            }
+            orderHoles += doomed.size();
+            if (2 * orderHoles > order.size())
+                compact_order();
+        }
+        if (reachedAfter) {
+            for (std::size_t k = 0; k < losers.size(); ++k)
+                influenceCache[losers[k]] -= (*reachedBefore)[k] - (*reachedAfter)[k];
+        } else {
+            influenceStale = true;
+        }
+        stats_.edges_erased(citationsBefore - citationCount);
+        stats_.cascade(doomed.size());
+        return doomed.size();
+    }
+
+    // Undoes the journal newest first. Every list only ever gets back the
+    // elements it lost since the transaction began, and lists never shrink,
+    // so nothing here allocates.
+    void rollback_transaction() noexcept {
+        for (std::size_t k = journal.size(); k-- > 0;) {
+            journal_entry const &entry = journal[k];
+            if (entry.kind == journal_entry::linked) {
+                nodes[entry.first].parents.erase(entry.second);
+                nodes[entry.second].children.erase(entry.first);
+                --citationCount;
+            } else if (entry.kind == journal_entry::created) {
+                Node &created = nodes[entry.first];
+                for (auto parent : created.parents)
+                    nodes[parent].children.erase(entry.first);
+                for (auto child : created.children)
+                    nodes[child].parents.erase(entry.first);
+                citationCount -= created.parents.size() + created.children.size();
+                if (entry.ordered)
+                    order.pop_back();
+                discard_node(entry.first, entry.second != 0);
+            } else {
+                for (std::size_t i = entry.first; i < entry.second; ++i) {
+                    index_type dead = parked[i];
+                    Node &deadNode = nodes[dead];
+                    citationCount += deadNode.parents.size();
+                    for (auto parent : deadNode.parents) {
+                        if (!nodes[parent].parked)
+                            nodes[parent].children.insert(dead);
+                    }
+                    for (auto child : deadNode.children) {
+                        if (!nodes[child].parked) {
+                            nodes[child].parents.insert(dead);
+                            ++citationCount;
+                        }
+                    }
+                }
+                for (std::size_t i = entry.first; i < entry.second; ++i) {
+                    nodes[parked[i]].parked = false;
+                    if (entry.ordered)
+                        order[nodes[parked[i]].rank] = parked[i];
+                }
+                if (entry.ordered)
+                    orderHoles -= entry.second - entry.first;
+                parked.resize(entry.first);
+            }
+        }
+        end_transaction();
+        restore_influence();
+        labelsStale = true;
+        citationsStale = true;
+    }
+
+    // Validates the order once for the whole transaction, then frees what it
+    // removed. On CitationCycle, or if that cannot be done, rolls back.
+    void commit_transaction() {
+        if (journal.empty()) {
+            end_transaction();
+            restore_influence();
+            return;
+        }
+        std::vector<index_type> newOrder;
+        try {
+            if (orderStale)
+                newOrder = kahn_order();
+            if (deferReclamation)
+                citation_graph_detail::reserve_more(retired, parked.size());
+            else
+                citation_graph_detail::reserve_more(freeSlots, parked.size());
+        } catch (...) {
+            rollback_transaction();
+            throw;
+        }
+        for (auto dead : parked) {
+            if (deferReclamation)
+                retire(dead);
+            else
+                free_node(dead);
+        }
+        if (orderStale) {
+            order.swap(newOrder);
+            orderHoles = 0;
+            for (std::size_t rank = 0; rank < order.size(); ++rank)
+                nodes[order[rank]].rank = std::uint32_t(rank);
+        } else if (2 * orderHoles > order.size()) {
+            compact_order();
+        }
+        parked.clear();
+        end_transaction();
+        influenceSaved = false;
+        std::vector<std::size_t>().swap(savedInfluence);
+    }
+
+    // Puts back the influence counts the transaction began with, if they
+    // were current.
+    void restore_influence() noexcept {
+        if (influenceSaved && trackInfluence) {
+            influenceCache.swap(savedInfluence);
+            influenceStale = false;
+        } else {
+            influenceStale = true;
+        }
+        influenceSaved = false;
+        std::vector<std::size_t>().swap(savedInfluence);
+    }
+
+    void end_transaction() noexcept {
+        journal.clear();
+        transaction = false;
+        orderStale = false;
+    }
+
+    // Slots whose publication or citation lists the open transaction has
+    // changed so far, possibly repeated.
+    std::vector<index_type> transaction_slots() const {
+        std::vector<index_type> slots;
+        auto touch = [this, &slots](index_type slot) {
+            slots.push_back(slot);
+            slots.insert(slots.end(), nodes[slot].parents.begin(), nodes[slot].parents.end());
+            slots.insert(slots.end(), nodes[slot].children.begin(), nodes[slot].children.end());
+        };
+        for (journal_entry const &entry : journal) {
+            if (entry.kind == journal_entry::linked) {
+                slots.push_back(entry.first);
+                slots.push_back(entry.second);
+            } else if (entry.kind == journal_entry::created) {
+                touch(entry.first);
+            } else {
+                for (std::size_t i = entry.first; i < entry.second; ++i)
+                    touch(parked[i]);
+            }
+        }
+        return slots;
+    }
+
+public:
+    // Read-only range over the ids of a publication's children or parents,
+    // iterated in place. Any mutation of the graph invalidates it.
+    class NeighborView {
+    public:
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = id_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = id_type const *;
+            using reference = id_type const &;
+
+            iterator() = default;
+
+            reference operator*() const noexcept {
+                return (*nodes)[*position].id();
+            }
+            pointer operator->() const noexcept {
+                return &**this;
+            }
+            iterator &operator++() noexcept {
+                ++position;
+                return *this;
+            }
+            iterator operator++(int) noexcept {
+                iterator previous = *this;
+                ++position;
+                return previous;
+            }
+            bool operator==(iterator const &other) const noexcept {
+                return position == other.position;
+            }
+            bool operator!=(iterator const &other) const noexcept {
+                return position != other.position;
+            }
+
+        private:
+            friend class NeighborView;
+            iterator(adjacency::const_iterator position, citation_graph_detail::chunked_arena<Node> const *nodes) noexcept
+                    : position(position), nodes(nodes) {}
+
+            adjacency::const_iterator position;
+            citation_graph_detail::chunked_arena<Node> const *nodes = nullptr;
+        };
+
+        iterator begin() const noexcept {
+            return iterator(neighbors -> begin(), nodes);
+        }
+        iterator end() const noexcept {
+            return iterator(neighbors -> end(), nodes);
+        }
+        std::size_t size() const noexcept {
+            return neighbors -> size();
+        }
+        bool empty() const noexcept {
+            return neighbors -> empty();
+        }
+
+    private:
+        friend class CitationGraph;
+        NeighborView(adjacency const *neighbors, citation_graph_detail::chunked_arena<Node> const *nodes) noexcept
+                : neighbors(neighbors), nodes(nodes) {}
+
+        adjacency const *neighbors;
+        citation_graph_detail::chunked_arena<Node> const *nodes;
+    };
+
+    // Nodes, adjacency lists and the id index allocate from resource, which
+    // must outlive the graph. With a std::pmr::monotonic_buffer_resource
+    // nothing is freed piecemeal, so tearing a graph down only runs
+    // destructors and the memory goes back in one release.
+    CitationGraph(id_type const &stem_id, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+            : CitationGraph(empty_graph {}, resource) {
+        root = index_type(nodes.grow());
+        nodes[root].emplace(stem_id);
+        nodes[root].entry = map -> insert(stem_id, root);
+        order.push_back(root);
+    }
+
+    // A moved-from graph may only be assigned to or destroyed.
+    CitationGraph(CitationGraph &&other) noexcept {
+        *this = std::move(other);
+    }
+    CitationGraph& operator=(CitationGraph &&other) noexcept {
+        std::swap(root, other.root);
+        nodes.swap(other.nodes);
+        map.swap(other.map);
+        freeSlots.swap(other.freeSlots);
+        std::swap(citationCount, other.citationCount);
+        marks.swap(other.marks);
+        survivingParents.swap(other.survivingParents);
+        std::swap(trackInfluence, other.trackInfluence);
+        std::swap(influenceStale, other.influenceStale);
+        influenceCache.swap(other.influenceCache);
+        std::swap(influenceSaved, other.influenceSaved);
+        savedInfluence.swap(other.savedInfluence);
+        reachMasks.swap(other.reachMasks);
+        std::swap(trackCitations, other.trackCitations);
+        std::swap(citationsStale, other.citationsStale);
+        citationRanking.swap(other.citationRanking);
+        order.swap(other.order);
+        std::swap(orderHoles, other.orderHoles);
+        std::swap(labelCount, other.labelCount);
+        std::swap(labelsStale, other.labelsStale);
+        labels.swap(other.labels);
+        std::swap(transaction, other.transaction);
+        std::swap(orderStale, other.orderStale);
+        journal.swap(other.journal);
+        parked.swap(other.parked);
+        std::swap(deferReclamation, other.deferReclamation);
+        std::swap(reclaimPerCall, other.reclaimPerCall);
+        retired.swap(other.retired);
+        std::swap(retiredCount, other.retiredCount);
+        stats_.swap(other.stats_);
+        return *this;
+    }
+
+    id_type get_root_id() const noexcept(noexcept(std::declval<Publication>().get_id())) {
+        return nodes[root].publication -> get_id();
+    }
+
+    std::vector<id_type> get_children(id_type const &id) const {
+        return ids_of(nodes[locate(id)].children);
+    }
+
+    std::vector<id_type> get_parents(id_type const &id) const {
+        return ids_of(nodes[locate(id)].parents);
+    }
+
+    bool exists(id_type const &id) const {
+        return lookup(id) != nullptr;
+    }
+
+    Publication& operator[](id_type const &id) const {
+        return *nodes[locate(id)].publication;
+    }
+
+    // Heterogeneous lookups: search with any key type the index can compare
+    // against id_type, without building a temporary id_type.
+    template <class Key, class = if_foreign_key<Key> >
+    std::vector<id_type> get_children(Key const &id) const {
+        return ids_of(nodes[locate(id)].children);
+    }
+
+    template <class Key, class = if_foreign_key<Key> >
+    std::vector<id_type> get_parents(Key const &id) const {
+        return ids_of(nodes[locate(id)].parents);
+    }
+
+    // Allocation-free alternatives to get_children and get_parents.
+    template <class Key>
+    NeighborView children_view(Key const &id) const {
+        return NeighborView(&nodes[locate(id)].children, &nodes);
+    }
+
+    template <class Key>
+    NeighborView parents_view(Key const &id) const {
+        return NeighborView(&nodes[locate(id)].parents, &nodes);
+    }
+
+    template <class Key, class Visitor>
+    void for_each_child(Key const &id, Visitor &&visit) const {
+        for (auto child : nodes[locate(id)].children)
+            visit(nodes[child].id());
+    }
+
+    template <class Key, class Visitor>
+    void for_each_parent(Key const &id, Visitor &&visit) const {
+        for (auto parent : nodes[locate(id)].parents)
+            visit(nodes[parent].id());
+    }
+
+    template <class Key, class = if_foreign_key<Key> >
+    bool exists(Key const &id) const {
+        return lookup(id) != nullptr;
+    }
+
+    template <class Key, class = if_foreign_key<Key> >
+    Publication& operator[](Key const &id) const {
+        return *nodes[locate(id)].publication;
+    }
+
+    // Handle-based access: O(1), no id lookups.
+    std::vector<id_type> get_children(NodeHandle handle) const {
+        return ids_of(nodes[locate(handle)].children);
+    }
+
+    std::vector<id_type> get_parents(NodeHandle handle) const {
+        return ids_of(nodes[locate(handle)].parents);
+    }
+
+    bool exists(NodeHandle handle) const noexcept {
+        return holds(handle);
+    }
+
+    Publication& operator[](NodeHandle handle) const {
+        return *nodes[locate(handle)].publication;
+    }
+
+    // Returns a handle to the publication, or an empty handle if there is none.
+    template <class Key>
+    NodeHandle find(Key const &id) const {
+        index_type const *found = lookup(id);
+        return found ? handle_of(*found) : NodeHandle();
+    }
+
+    // Dense integer keys. Each id is mapped to a key once, by create, and
+    // the graph links publications by key internally, so key-based calls
+    // neither search the id index nor copy ids: a traversal can resolve its
+    // start once and then stay on keys, indexing its own arrays of
+    // key_bound() entries by them. A key names its publication until that
+    // is removed, after which a new publication may get the same key; hold
+    // a NodeHandle to notice that. Key-based calls throw PublicationNotFound
+    // for keys no publication has.
+    using key_type = index_type;
+
+    class KeyView {
+    public:
+        using value_type = key_type;
+        using iterator = adjacency::const_iterator;
+
+        iterator begin() const noexcept {
+            return first;
+        }
+        iterator end() const noexcept {
+            return last;
+        }
+        std::size_t size() const noexcept {
+            return count;
+        }
+        bool empty() const noexcept {
+            return count == 0;
+        }
+
+    private:
+        friend class CitationGraph;
+        explicit KeyView(adjacency const &keys) noexcept : first(keys.begin()), last(keys.end()), count(keys.size()) {}
+
+        iterator first;
+        iterator last;
+        std::size_t count;
+    };
+
+    template <class Key>
+    key_type key_of(Key const &id) const {
+        return locate(id);
+    }
+
+    key_type key_of(NodeHandle handle) const {
+        return locate(handle);
+    }
+
+    // Every key is below this bound.
+    std::size_t key_bound() const noexcept {
+        return nodes.size();
+    }
+
+    bool contains_key(key_type key) const noexcept {
+        return key < nodes.size() && nodes[key].publication && !nodes[key].parked;
+    }
+
+    id_type const &id_of(key_type key) const {
+        return nodes[checked(key)].id();
+    }
+
+    Publication &publication_at(key_type key) const {
+        return *nodes[checked(key)].publication;
+    }
+
+    NodeHandle handle_at(key_type key) const {
+        return handle_of(checked(key));
+    }
+
+    // Sorted; invalidated by any mutation, like NeighborView.
+    KeyView child_keys(key_type key) const {
+        return KeyView(nodes[checked(key)].children);
+    }
+
+    KeyView parent_keys(key_type key) const {
+        return KeyView(nodes[checked(key)].parents);
+    }
+
+    NodeHandle create(id_type const &id, id_type const &parent_id) {
+        return create(id, std::vector<id_type> {parent_id});
+    }
+    NodeHandle create(id_type const &id, std::vector<id_type> const &parent_ids) {
+        if (exists(id))
+            throw PublicationAlreadyCreated();
+        std::vector<index_type> parents;
+        parents.reserve(parent_ids.size());
+        for (auto const &parent : parent_ids)
+            parents.push_back(locate(parent));
+        return insert_node(id, std::move(parents));
+    }
+    NodeHandle create(id_type const &id, std::vector<NodeHandle> const &parent_handles) {
+        if (exists(id))
+            throw PublicationAlreadyCreated();
+        std::vector<index_type> parents;
+        parents.reserve(parent_handles.size());
+        for (auto parent : parent_handles)
+            parents.push_back(locate(parent));
+        return insert_node(id, std::move(parents));
+    }
+
+    // Adds many publications and citations in one pass. ids are the new
+    // publications; citations are (child, parent) pairs, as in add_citation,
+    // whose ends may be new or already present. Every new publication must
+    // cite at least one other. On exception nothing is added.
+    void create_batch(std::vector<id_type> const &ids,
+                      std::vector<std::pair<id_type, id_type> > const &citations) {
+        using edge = std::pair<index_type, index_type>;
+        reclaim_slice();
+        for (auto const &id : ids)
+            release_retired(id);
+        std::size_t reusedCount = std::min(ids.size(), freeSlots.size());
+        nodes.reserve(nodes.size() + ids.size() - reusedCount);
+        map -> reserve(map -> size() + ids.size());
+
+        std::vector<index_type> added;
+        std::vector<index_type> fresh;
+        std::vector<edge> byChild;
+        std::vector<edge> byParent;
+        std::vector<index_type> newOrder;
+        bool reordered = false;
+        try {
+            added.reserve(ids.size());
+            for (auto const &id : ids) {
+                if (exists(id))
+                    throw PublicationAlreadyCreated();
+                added.push_back(emplace_node(id));
+            }
+
+            byChild.reserve(citations.size());
+            for (auto const &citation : citations)
+                byChild.emplace_back(locate(citation.first), locate(citation.second));
+            std::sort(byChild.begin(), byChild.end());
+            byChild.erase(std::unique(byChild.begin(), byChild.end()), byChild.end());
+            byChild.erase(std::remove_if(byChild.begin(), byChild.end(), [this](edge const &e) {
+                return nodes[e.first].parents.contains(e.second);
+            }), byChild.end());
+            byParent.reserve(byChild.size());
+            for (auto const &e : byChild)
+                byParent.emplace_back(e.second, e.first);
+            std::sort(byParent.begin(), byParent.end());
+
+            fresh = added;
+            std::sort(fresh.begin(), fresh.end());
+            for (auto slot : fresh) {
+                auto first = std::lower_bound(byChild.begin(), byChild.end(), edge(slot, 0));
+                if (first == byChild.end() || first -> first != slot)
+                    throw PublicationNotFound();
+            }
+
+            // New publications get their adjacency now; existing ones only
+            // reserve room, so that linking them below cannot fail.
+            auto stage = [this, &fresh](std::vector<edge> const &edges, adjacency Node::*list) {
+                for_each_group(edges, [&](index_type key, auto first, auto last) {
+                    adjacency &neighbors = nodes[key].*list;
+                    make_room(neighbors, std::size_t(last - first));
+                    if (std::binary_search(fresh.begin(), fresh.end(), key))
+                        neighbors.merge(first, last, [](edge const &e) { return e.second; });
+                });
+            };
+            stage(byChild, &Node::parents);
+            stage(byParent, &Node::children);
+
+            // New publications are appended in an order of their own, unless
+            // the batch cites against the current order between existing
+            // ones; then the whole order is recomputed.
+            auto isFresh = [&fresh](index_type slot) {
+                return std::binary_search(fresh.begin(), fresh.end(), slot);
+            };
+            reordered = std::any_of(byChild.begin(), byChild.end(), [&](edge const &e) {
+                return !isFresh(e.first) && (isFresh(e.second) || nodes[e.second].rank >= nodes[e.first].rank);
+            });
+            auto group = [](std::vector<edge> const &edges, index_type key) {
+                auto first = std::lower_bound(edges.begin(), edges.end(), edge(key, 0));
+                auto last = first;
+                while (last != edges.end() && last -> first == key)
+                    ++last;
+                return std::make_pair(first, last);
+            };
+            if (transaction) {
+                // Ordered, and checked for cycles, at commit.
+                make_room(journal, added.size() + byChild.size());
+            } else if (reordered) {
+                newOrder = kahn_order([&](index_type slot) -> std::size_t {
+                    if (isFresh(slot))
+                        return 0;
+                    auto extra = group(byChild, slot);
+                    return std::size_t(extra.second - extra.first);
+                }, [&](index_type slot, auto &&reach) {
+                    if (isFresh(slot))
+                        return;
+                    auto extra = group(byParent, slot);
+                    for (; extra.first != extra.second; ++extra.first)
+                        reach(extra.first -> second);
+                });
+            } else {
+                std::unordered_map<index_type, std::size_t> pendingParents;
+                for (auto slot : fresh) {
+                    std::size_t count = std::size_t(std::count_if(nodes[slot].parents.begin(),
+                                                                  nodes[slot].parents.end(), isFresh));
+                    if (count == 0)
+                        newOrder.push_back(slot);
+                    else
+                        pendingParents[slot] = count;
+                }
+                for (std::size_t next = 0; next < newOrder.size(); ++next) {
+                    for (auto child : nodes[newOrder[next]].children) {
+                        if (isFresh(child) && --pendingParents[child] == 0)
+                            newOrder.push_back(child);
+                    }
+                }
+                if (newOrder.size() != fresh.size())
+                    throw CitationCycle();
+                make_room(order, newOrder.size());
+            }
+        } catch (...) {
+            for (std::size_t k = added.size(); k-- > 0;)
+                discard_node(added[k], k < reusedCount);
+            throw;
+        }
+
+        auto merge = [this, &fresh](std::vector<edge> const &edges, adjacency Node::*list) noexcept {
+            for_each_group(edges, [&](index_type key, auto first, auto last) {
+                if (std::binary_search(fresh.begin(), fresh.end(), key))
+                    return;
+                (nodes[key].*list).merge(first, last, [](edge const &e) { return e.second; });
+            });
+        };
+        merge(byChild, &Node::parents);
+        merge(byParent, &Node::children);
+        citationCount += byChild.size();
+        stats_.edges_inserted(byChild.size());
+        influenceStale = true;
+        labelsStale = true;
+        citationsStale = true;
+
+        if (transaction) {
+            // Citations of new publications go with them on rollback.
+            for (std::size_t k = 0; k < added.size(); ++k)
+                journal.push_back({journal_entry::created, added[k], index_type(k < reusedCount), false});
+            for (auto const &e : byChild) {
+                if (!std::binary_search(fresh.begin(), fresh.end(), e.first)
+                        && !std::binary_search(fresh.begin(), fresh.end(), e.second))
+                    journal.push_back({journal_entry::linked, e.first, e.second, false});
+            }
+            orderStale = true;
+        } else if (reordered) {
+            order.swap(newOrder);
+            orderHoles = 0;
+            for (std::size_t rank = 0; rank < order.size(); ++rank)
+                nodes[order[rank]].rank = std::uint32_t(rank);
+        } else {
+            for (auto slot : newOrder) {
+                nodes[slot].rank = std::uint32_t(order.size());
+                order.push_back(slot);
+            }
+        }
+    }
+
+    // Builds a graph with the given root in one pass; see create_batch.
+    static CitationGraph build(id_type const &root_id, std::vector<id_type> const &ids,
+                               std::vector<std::pair<id_type, id_type> > const &citations) {
+        CitationGraph graph(root_id);
+        graph.create_batch(ids, citations);
+        return graph;
+    }
+
+    void add_citation(id_type const &child_id, id_type const &parent_id) {
+        link(locate(child_id), locate(parent_id));
+    }
+    void add_citation(NodeHandle child, NodeHandle parent) {
+        link(locate(child), locate(parent));
+    }
+
+    void remove(id_type const &id) {
+        index_type victim = locate(id);
+        if (victim == root)
+            throw TriedToRemoveRoot();
+        erase_cascade({victim});
+    }
+
+    // Removes all given publications at once, together with everything that
+    // only they kept alive, and returns the number of publications reclaimed.
+    // Either every id is removed or, on exception, none is.
+    std::size_t remove_many(std::vector<id_type> const &ids) {
+        std::vector<index_type> victims;
+        victims.reserve(ids.size());
+        for (auto const &id : ids) {
+            victims.push_back(locate(id));
+            if (victims.back() == root)
+                throw TriedToRemoveRoot();
+        }
+        std::sort(victims.begin(), victims.end());
+        victims.erase(std::unique(victims.begin(), victims.end()), victims.end());
+        return erase_cascade(std::move(victims));
+    }
+
+    // With deferred reclamation on, remove() only unlinks what it removes
+    // from the rest of the graph and retires it: queries stop seeing it at
+    // once, but the publications are destroyed and their memory freed later,
+    // per_call of them at the start of each following create, create_batch,
+    // add_citation or remove. This moves only the destruction and freeing
+    // out of remove(): finding the cascade and unlinking it from the
+    // survivors still happen at once, so a removal's latency stays
+    // O(cascade size plus the citations it loses). An id can be created
+    // again right after its removal. Turning it off drains what is left.
+    void defer_reclamation(bool enabled, std::size_t per_call = 256) {
+        if (!enabled)
+            drain();
+        deferReclamation = enabled;
+        reclaimPerCall = per_call;
+    }
+
+    // Frees everything retired so far; returns how many publications that was.
+    std::size_t drain() {
+        std::size_t freed = reclaim(retiredCount);
+        retired.clear();
+        return freed;
+    }
+
+    // Groups create, create_batch, add_citation and remove calls so that they
+    // take effect together or not at all. Inside a transaction each call still
+    // either succeeds or changes nothing, but citations are checked for cycles
+    // only once, by commit(), and removed publications are only freed there;
+    // until then their ids cannot be created again. Queries see the changes
+    // made so far. Destroying an uncommitted transaction rolls it back, so
+    // one dropped on the spot would undo everything after it; the compiler
+    // warns about that. The graph must outlive the transaction and must not
+    // be moved meanwhile.
+    class [[nodiscard]] Transaction {
+    public:
+        Transaction(Transaction &&other) noexcept : graph(other.graph) {
+            other.graph = nullptr;
+        }
+        Transaction &operator=(Transaction &&) = delete;
+
+        ~Transaction() {
+            rollback();
+        }
+
+        // Throws CitationCycle, after rolling back, if the changes close a
+        // cycle.
+        void commit() {
+            CitationGraph *owner = graph;
+            graph = nullptr;
+            if (owner)
+                owner -> commit_transaction();
+        }
+
+        void rollback() noexcept {
+            if (graph)
+                graph -> rollback_transaction();
+            graph = nullptr;
+        }
+
+    private:
+        friend class CitationGraph;
+        explicit Transaction(CitationGraph *graph) noexcept : graph(graph) {}
+
+        CitationGraph *graph;
+    };
+
+    // Throws TransactionInProgress if one is open already.
+    Transaction begin_transaction() {
+        if (transaction)
+            throw TransactionInProgress();
+        // Reclaiming inside the transaction must leave rollback room to give
+        // back every slot it reused.
+        citation_graph_detail::reserve_more(freeSlots, retiredCount);
+        transaction = true;
+        if (trackInfluence && !influenceStale) {
+            savedInfluence.swap(influenceCache);
+            influenceSaved = true;
+        }
+        influenceStale = true;
+        return Transaction(this);
+    }
+
+    MemoryStats memory_stats() const noexcept {
+        std::size_t live = live_count();
+        return MemoryStats {live, map -> size() - live, freeSlots.size(), nodes.size(), citationCount, retiredCount};
+    }
+
+    // Counters kept by StatsPolicy, for scraping by a metrics exporter.
+    CitationGraphStats stats() const noexcept {
+        CitationGraphStats result;
+        stats_.read(result);
+        result.live_publications = live_count();
+        result.free_slots = freeSlots.size();
+        return result;
+    }
+
+    // Number of publications that cite the given one directly, and that it
+    // cites. O(1); unlike get_children(id).size(), copies nothing.
+    template <class Key>
+    std::size_t citation_count(Key const &id) const {
+        return nodes[locate(id)].children.size();
+    }
+
+    template <class Key>
+    std::size_t reference_count(Key const &id) const {
+        return nodes[locate(id)].parents.size();
+    }
+
+    // The k most cited publications with their citation_count(), most cited
+    // first; ties come in no particular order. O(k) while tracking keeps
+    // the ranking current, O(n log k) otherwise.
+    std::vector<std::pair<id_type, std::size_t> > top_cited(std::size_t k) const {
+        std::vector<std::pair<id_type, std::size_t> > result;
+        if (trackCitations) {
+            refresh_citations();
+            std::vector<index_type> const &ranked = citationRanking.keys();
+            k = std::min(k, ranked.size());
+            result.reserve(k);
+            for (std::size_t i = 0; i < k; ++i)
+                result.emplace_back(nodes[ranked[i]].id(), citationRanking.count(ranked[i]));
+            return result;
+        }
+        std::vector<std::pair<std::size_t, index_type> > counted;
+        counted.reserve(live_count());
+        for (index_type slot = 0; slot < nodes.size(); ++slot) {
+            if (nodes[slot].publication && !nodes[slot].parked)
+                counted.emplace_back(nodes[slot].children.size(), slot);
+        }
+        k = std::min(k, counted.size());
+        std::partial_sort(counted.begin(), counted.begin() + k, counted.end(),
+                          [](auto const &a, auto const &b) { return a.first > b.first; });
+        result.reserve(k);
+        for (std::size_t i = 0; i < k; ++i)
+            result.emplace_back(nodes[counted[i].second].id(), counted[i].first);
+        return result;
+    }
+
+    // Number of publications that transitively cite the given one.
+    template <class Key>
+    std::size_t influence(Key const &id) const {
+        index_type slot = locate(id);
+        if (trackInfluence) {
+            refresh_influence();
+            return influenceCache[slot];
+        }
+        return walk({slot}, &Node::children).size() - 1;
+    }
+
+    // influence() of every publication, listed in topological order. Exact;
+    // costs O(n * (n + m) / 64) unless tracking keeps the counts current.
+    std::vector<std::pair<id_type, std::size_t> > influence_all() const {
+        std::vector<index_type> order = topological_slots();
+        std::vector<std::size_t> counts;
+        if (trackInfluence)
+            refresh_influence();
+        else
+            counts = count_descendants();
+        std::vector<std::size_t> const &source = trackInfluence ? influenceCache : counts;
+        std::vector<std::pair<id_type, std::size_t> > result;
+        result.reserve(order.size());
+        for (auto slot : order)
+            result.emplace_back(nodes[slot].id(), source[slot]);
+        return result;
+    }
+
+    // Approximate influence_all() in O(k * (n + m) log k) using bottom-k
+    // sketches: every publication keeps the k smallest hashes among its
+    // descendants, merged from its children in reverse topological order.
+    // Counts below k are exact; larger ones have a relative error of about
+    // 1 / sqrt(k - 2).
+    std::vector<std::pair<id_type, double> > estimate_influence_all(std::size_t sketch_size = 64) const {
+        std::size_t k = std::max<std::size_t>(sketch_size, 3);
+        std::vector<index_type> order = topological_slots();
+        std::vector<std::vector<std::uint64_t> > sketches(nodes.size());
+        std::vector<std::size_t> pendingParents(nodes.size());
+        for (auto slot : order)
+            pendingParents[slot] = nodes[slot].parents.size();
+        std::vector<double> estimates(nodes.size());
+        std::vector<std::uint64_t> merged;
+        for (std::size_t i = order.size(); i-- > 0;) {
+            index_type slot = order[i];
+            merged.assign(1, citation_graph_detail::mix64(slot + 1));
+            for (auto child : nodes[slot].children) {
+                merged.insert(merged.end(), sketches[child].begin(), sketches[child].end());
+                if (--pendingParents[child] == 0)
+                    std::vector<std::uint64_t>().swap(sketches[child]);
+            }
+            std::sort(merged.begin(), merged.end());
+            merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+            if (merged.size() > k)
+                merged.resize(k);
+            if (merged.size() < k)
+                estimates[slot] = double(merged.size() - 1);
+            else
+                estimates[slot] = double(k - 1) / (double(merged.back()) / 18446744073709551616.0) - 1;
+            sketches[slot] = merged;
+        }
+        std::vector<std::pair<id_type, double> > result;
+        result.reserve(order.size());
+        for (auto slot : order)
+            result.emplace_back(nodes[slot].id(), estimates[slot]);
+        return result;
+    }
+
+    // Publications with every cited one before those citing it. The order is
+    // maintained incrementally, so this is a plain copy.
+    std::vector<id_type> topological_order() const {
+        return ids_of(topological_slots());
+    }
+
+    // A copy of the graph in compressed sparse rows. O(n + m).
+    CompressedCitationGraph<id_type> compress() const {
+        std::vector<index_type> slots = topological_slots();
+        std::vector<std::uint32_t> position(nodes.size());
+        for (std::size_t i = 0; i < slots.size(); ++i)
+            position[slots[i]] = std::uint32_t(i);
+
+        CompressedCitationGraph<id_type> result;
+        result.ids = ids_of(slots);
+        result.child_offsets.reserve(slots.size() + 1);
+        result.parent_offsets.reserve(slots.size() + 1);
+        result.children.reserve(citationCount);
+        result.parents.reserve(citationCount);
+        auto append = [&position](std::vector<std::uint32_t> &out, adjacency const &neighbors) {
+            std::size_t first = out.size();
+            for (auto neighbor : neighbors)
+                out.push_back(position[neighbor]);
+            std::sort(out.begin() + first, out.end());
+        };
+        result.child_offsets.push_back(0);
+        result.parent_offsets.push_back(0);
+        for (auto slot : slots) {
+            append(result.children, nodes[slot].children);
+            result.child_offsets.push_back(result.children.size());
+            append(result.parents, nodes[slot].parents);
+            result.parent_offsets.push_back(result.parents.size());
+        }
+        return result;
+    }
+
+    // While tracking is on, influence() answers from cached counts. create()
+    // updates them incrementally, and add_citation() and removals by the
+    // change they make, unless that would cost more than about one pass over
+    // the graph. Batches, those costlier changes and transactions mark them
+    // stale and the next query recomputes them in one batch; rolling back a
+    // transaction puts back the counts it began with.
+    void track_influence(bool enabled) {
+        trackInfluence = enabled;
+        influenceStale = true;
+        if (!enabled)
+            std::vector<std::size_t>().swap(influenceCache);
+    }
+
+    // While tracking is on, top_cited() reads a ranking of publications by
+    // citation count. create(), add_citation() and removals update it in
+    // O(1) per citation they add or drop; batches and rollbacks mark it
+    // stale and the next query rebuilds it in O(n + m).
+    void track_citations(bool enabled) {
+        trackCitations = enabled;
+        citationsStale = true;
+        if (!enabled)
+            citation_graph_detail::ranked_counts().swap(citationRanking);
+    }
+
+    // Whether descendant transitively cites ancestor; a publication is not
+    // its own descendant.
+    template <class AncestorKey, class DescendantKey>
+    bool is_descendant(AncestorKey const &ancestor, DescendantKey const &descendant) const {
+        index_type from = locate(ancestor);
+        index_type to = locate(descendant);
+        return reaches(from, to);
+    }
+
+    // Keeps that many interval labels per publication for is_descendant(),
+    // at 8 bytes each; 0 drops the index. Every label lets more queries be
+    // refuted outright and prunes the search behind the rest; without any,
+    // only the topological order prunes it. Labels are built by the next
+    // query, survive create() and remove(), and are rebuilt lazily after
+    // citations that break them.
+    void index_reachability(std::size_t labels_per_publication) {
+        labelCount = labels_per_publication;
+        labelsStale = true;
+        std::vector<std::uint32_t>().swap(labels);
+    }
+
+    // Writes the graph in the snapshot format described at snapshot_header.
+    // The file is written next to path and renamed over it once complete.
+    void save(std::string const &path) const {
+        using citation_graph_detail::snapshot_align;
+        std::vector<index_type> order;
+        order.reserve(live_count());
+        for (index_type slot = 0; slot < nodes.size(); ++slot) {
+            if (nodes[slot].publication && !nodes[slot].parked)
+                order.push_back(slot);
+        }
+        std::sort(order.begin(), order.end(), [this](index_type a, index_type b) {
+            return nodes[a].id() < nodes[b].id();
+        });
+        std::vector<std::uint32_t> position(nodes.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+            position[order[i]] = std::uint32_t(i);
+
+        std::string ids;
+        std::vector<std::uint64_t> idOffsets {0};
+        std::vector<std::uint64_t> childOffsets {0};
+        std::vector<std::uint64_t> parentOffsets {0};
+        std::vector<std::uint32_t> children;
+        std::vector<std::uint32_t> parents;
+        idOffsets.reserve(order.size() + 1);
+        childOffsets.reserve(order.size() + 1);
+        parentOffsets.reserve(order.size() + 1);
+        children.reserve(citationCount);
+        parents.reserve(citationCount);
+        auto append = [&position](std::vector<std::uint32_t> &out, adjacency const &neighbors) {
+            std::size_t first = out.size();
+            for (auto neighbor : neighbors)
+                out.push_back(position[neighbor]);
+            std::sort(out.begin() + first, out.end());
+        };
+        for (auto slot : order) {
+            CitationIdCodec<id_type>::write(ids, nodes[slot].id());
+            idOffsets.push_back(ids.size());
+            append(children, nodes[slot].children);
+            childOffsets.push_back(children.size());
+            append(parents, nodes[slot].parents);
+            parentOffsets.push_back(parents.size());
+        }
+
+        citation_graph_detail::snapshot_header header {};
+        std::memcpy(header.magic, citation_graph_detail::snapshot_magic, sizeof(header.magic));
+        header.version = citation_graph_detail::snapshot_version;
+        header.byte_order = citation_graph_detail::snapshot_byte_order;
+        header.publications = order.size();
+        header.citations = children.size();
+        header.id_bytes = ids.size();
+        header.root = position[root];
+
+        // Everything after the header, padded as described there.
+        auto body = [&](auto &&put) {
+            std::uint64_t offset = sizeof(header);
+            auto piece = [&](void const *data, std::size_t size) {
+                put(data, size);
+                offset += size;
+            };
+            auto pad = [&]() {
+                static char const zeros[8] = {};
+                piece(zeros, std::size_t(snapshot_align(offset) - offset));
+            };
+            piece(idOffsets.data(), 8 * idOffsets.size());
+            piece(ids.data(), ids.size());
+            pad();
+            piece(childOffsets.data(), 8 * childOffsets.size());
+            piece(children.data(), 4 * children.size());
+            pad();
+            piece(parentOffsets.data(), 8 * parentOffsets.size());
+            piece(parents.data(), 4 * parents.size());
+            pad();
+        };
+        citation_graph_detail::snapshot_checksum checksum;
+        body([&checksum](void const *data, std::size_t size) { checksum.add(data, size); });
+        header.checksum = checksum.value();
+
+        std::string temporary = path + ".tmp";
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(temporary.c_str(), "wb"), &std::fclose);
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), temporary);
+        auto write = [&](void const *data, std::size_t size) {
+            if (size != 0 && std::fwrite(data, 1, size, file.get()) != size)
+                throw std::system_error(errno, std::generic_category(), temporary);
+        };
+        try {
+            write(&header, sizeof(header));
+            body(write);
+            if (std::fflush(file.get()) != 0)
+                throw std::system_error(errno, std::generic_category(), temporary);
+            if (std::fclose(file.release()) != 0)
+                throw std::system_error(errno, std::generic_category(), temporary);
+            if (std::rename(temporary.c_str(), path.c_str()) != 0)
+                throw std::system_error(errno, std::generic_category(), path);
+        } catch (...) {
+            file.reset();
+            std::remove(temporary.c_str());
+            throw;
+        }
+    }
+
+    // Reads a graph written by save(), after checking the whole file: its
+    // checksum, and that every citation is listed exactly once from each
+    // end. To query a snapshot without building a graph, open it as a
+    // MappedCitationGraph instead.
+    static CitationGraph load(std::string const &path,
+                              std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+        return CitationGraph(MappedCitationGraph<Publication>(path), resource);
+    }
+
+    // A deep copy, with publications copied and handles still valid in it.
+    // Copying stays a compile error so that it never happens by accident.
+    // Inside a transaction, the copy holds its changes so far, committed.
+    // The copy starts from this graph's counters.
+    // Strong guarantee.
+    CitationGraph clone() const {
+        return clone(nodes.resource());
+    }
+
+    CitationGraph clone(std::pmr::memory_resource *resource) const {
+        CitationGraph copy(empty_graph {}, resource);
+        copy.nodes.reserve(nodes.size());
+        copy.map -> reserve(live_count());
+        copy.freeSlots = freeSlots;
+        for (index_type slot = 0; slot < nodes.size(); ++slot) {
+            copy.nodes.grow();
+            Node const &from = nodes[slot];
+            Node &to = copy.nodes[slot];
+            to.generation = from.generation;
+            to.rank = from.rank;
+            if (from.parked)
+                copy.freeSlots.push_back(slot);
+            if (!from.publication || from.parked)
+                continue;
+            to.publication.emplace(*from.publication);
+            to.idCopy = from.idCopy;
+            to.children = from.children;
+            to.parents = from.parents;
+            to.entry = copy.map -> insert(from.id(), slot);
+        }
+        copy.root = root;
+        copy.citationCount = citationCount;
+        copy.order = order;
+        copy.orderHoles = orderHoles;
+        if (orderStale) {
+            copy.order = copy.kahn_order();
+            copy.orderHoles = 0;
+            for (std::size_t rank = 0; rank < copy.order.size(); ++rank)
+                copy.nodes[copy.order[rank]].rank = std::uint32_t(rank);
+        }
+        copy.trackInfluence = trackInfluence;
+        copy.trackCitations = trackCitations;
+        copy.labelCount = labelCount;
+        copy.deferReclamation = deferReclamation;
+        copy.reclaimPerCall = reclaimPerCall;
+        copy.stats_.assign(stats_);
+        return copy;
+    }
+
+    std::pmr::memory_resource *resource() const noexcept {
+        return nodes.resource();
+    }
+
+private:
+    struct empty_graph {};
+
+    CitationGraph(empty_graph, std::pmr::memory_resource *resource) : nodes(resource), map(make_index(resource)) {}
+
+    static std::unique_ptr<id_index> make_index(std::pmr::memory_resource *resource) {
+        if constexpr (std::is_constructible<id_index, std::pmr::memory_resource *>::value)
+            return std::make_unique<id_index>(resource);
+        else
+            return std::make_unique<id_index>();
+    }
+
+    CitationGraph(MappedCitationGraph<Publication> const &snapshot, std::pmr::memory_resource *resource)
+            : CitationGraph(empty_graph {}, resource) {
+        std::size_t count = snapshot.size();
+        if (count >= adjacency::marked || !snapshot.intact())
+            throw InvalidSnapshot();
+        nodes.reserve(count);
+        map -> reserve(count);
+        auto copy = [count](adjacency &out, std::pair<std::uint32_t const *, std::uint32_t const *> range) {
+            if (std::adjacent_find(range.first, range.second, std::greater_equal<std::uint32_t>()) != range.second
+                    || (range.first != range.second && range.second[-1] >= count))
+                throw InvalidSnapshot();
+            adjacency(range.first, range.second, out.get_allocator()).swap(out);
+        };
+        for (std::uint32_t position = 0; position < count; ++position) {
+            index_type slot = index_type(nodes.grow());
+            Node &node = nodes[slot];
+            node.emplace(snapshot.id_at(position));
+            if (slot > 0 && !(nodes[slot - 1].id() < node.id()))
+                throw InvalidSnapshot();
+            node.entry = map -> insert(node.id(), slot);
+            copy(node.children, snapshot.children_at(position));
+            copy(node.parents, snapshot.parents_at(position));
+            citationCount += node.parents.size();
+        }
+        // Both ends list the same number of citations, so it is enough that
+        // each child lists its parent back.
+        for (index_type slot = 0; slot < count; ++slot) {
+            for (auto child : nodes[slot].children) {
+                if (!nodes[child].parents.contains(slot))
+                    throw InvalidSnapshot();
+            }
+        }
+        root = snapshot.root_position();
+        if (!nodes[root].parents.empty())
+            throw InvalidSnapshot();
+        try {
+            order = kahn_order();
+        } catch (CitationCycle &) {
+            throw InvalidSnapshot();
+        }
+        for (std::size_t rank = 0; rank < order.size(); ++rank)
+            nodes[order[rank]].rank = std::uint32_t(rank);
+    }
+
+};
+
+// Read-only view of a snapshot written by CitationGraph::save. The file is
+// mapped into memory and queried in place; opening it costs O(1) regardless
+// of its size. Publications are addressed by their position in the id table.
+template <class Publication>
+class MappedCitationGraph {
+public:
+    using id_type = typename Publication::id_type;
+    using range = std::pair<std::uint32_t const *, std::uint32_t const *>;
+
+    explicit MappedCitationGraph(std::string const &path) : file(path) {
+        if (file.size() < sizeof(header))
+            throw InvalidSnapshot();
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, citation_graph_detail::snapshot_magic, sizeof(header.magic)) != 0
+                || header.version == 0 || header.version > citation_graph_detail::snapshot_version
+                || header.byte_order != citation_graph_detail::snapshot_byte_order
+                || header.publications == 0 || header.publications > UINT32_MAX
+                || header.root >= header.publications
+                || header.citations > file.size() || header.id_bytes > file.size())
+            throw InvalidSnapshot();
+        citation_graph_detail::snapshot_sections sections(header);
+        if (sections.end != file.size())
+            throw InvalidSnapshot();
+        idOffsets = section<std::uint64_t>(sections.id_offsets);
+        ids = file.data() + sections.ids;
+        childOffsets = section<std::uint64_t>(sections.child_offsets);
+        children = section<std::uint32_t>(sections.children);
+        parentOffsets = section<std::uint64_t>(sections.parent_offsets);
+        parents = section<std::uint32_t>(sections.parents);
+        if (idOffsets[header.publications] != header.id_bytes
+                || childOffsets[header.publications] != header.citations
+                || parentOffsets[header.publications] != header.citations)
+            throw InvalidSnapshot();
+    }
+
+    std::size_t size() const noexcept {
+        return std::size_t(header.publications);
+    }
+
+    std::size_t citation_count() const noexcept {
+        return std::size_t(header.citations);
+    }
+
+    std::uint32_t root_position() const noexcept {
+        return header.root;
+    }
+
+    // Whether the file still matches the checksum it was saved with; reads
+    // all of it.
+    bool intact() const noexcept {
+        if (header.version < 2)
+            return true;
+        citation_graph_detail::snapshot_checksum checksum;
+        checksum.add(file.data() + sizeof(header), file.size() - sizeof(header));
+        return checksum.value() == header.checksum;
+    }
+
+    id_type get_root_id() const {
+        return id_at(header.root);
+    }
+
+    id_type id_at(std::uint32_t position) const {
+        check(idOffsets, position, header.id_bytes);
+        return CitationIdCodec<id_type>::read(ids + idOffsets[position], ids + idOffsets[position + 1]);
+    }
+
+    range children_at(std::uint32_t position) const {
+        check(childOffsets, position, header.citations);
+        return range(children + childOffsets[position], children + childOffsets[position + 1]);
+    }
+
+    range parents_at(std::uint32_t position) const {
+        check(parentOffsets, position, header.citations);
+        return range(parents + parentOffsets[position], parents + parentOffsets[position + 1]);
+    }
+
+    // Binary search over the id table.
+    std::optional<std::uint32_t> find(id_type const &id) const {
+        std::uint32_t first = 0;
+        std::uint32_t last = std::uint32_t(header.publications);
+        while (first < last) {
+            std::uint32_t middle = first + (last - first) / 2;
+            if (id_at(middle) < id)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        if (first < header.publications && id_at(first) == id)
+            return first;
+        return std::nullopt;
+    }
+
+    bool exists(id_type const &id) const {
+        return find(id).has_value();
+    }
+
+    std::vector<id_type> get_children(id_type const &id) const {
+        return ids_of(children_at(locate(id)));
+    }
+
+    std::vector<id_type> get_parents(id_type const &id) const {
+        return ids_of(parents_at(locate(id)));
+    }
+
+private:
+    citation_graph_detail::mapped_file file;
+    citation_graph_detail::snapshot_header header;
+    std::uint64_t const *idOffsets;
+    char const *ids;
+    std::uint64_t const *childOffsets;
+    std::uint32_t const *children;
+    std::uint64_t const *parentOffsets;
+    std::uint32_t const *parents;
+
+    template <class T>
+    T const *section(std::uint64_t offset) const noexcept {
+        return reinterpret_cast<T const *>(file.data() + offset);
+    }
+
+    void check(std::uint64_t const *offsets, std::uint32_t position, std::uint64_t limit) const {
+        if (position >= header.publications || offsets[position] > offsets[position + 1]
+                || offsets[position + 1] > limit)
+            throw InvalidSnapshot();
+    }
+
+    std::uint32_t locate(id_type const &id) const {
+        auto position = find(id);
+        if (!position)
+            throw PublicationNotFound();
+        return *position;
+    }
+
+    std::vector<id_type> ids_of(range neighbors) const {
+        std::vector<id_type> result;
+        result.reserve(std::size_t(neighbors.second - neighbors.first));
+        for (; neighbors.first != neighbors.second; ++neighbors.first) {
+            if (*neighbors.first >= header.publications)
+                throw InvalidSnapshot();
+            result.push_back(id_at(*neighbors.first));
+        }
+        return result;
+    }
 };
 
 #endif //CITATION_GRAPH_H
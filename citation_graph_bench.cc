@@ -0,0 +1,411 @@
+#include "citation_graph.h"
+#include "citation_graph_concurrent.h"
+#include "citation_graph_sharded.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// Synthetic citation workloads for CitationGraph, reported one JSON object
+// (or CSV row) per measured operation so results can be diffed between runs.
+//
+//   grafCytowanBench [--nodes N] [--citations C] [--chain P] [--seed S]
+//                    [--queries Q] [--index ordered|hash|dense] [--format json|csv]
+
+class Publication {
+public:
+    typedef std::uint64_t id_type;
+    Publication(id_type const &_id) : id(_id) {
+    }
+    id_type get_id() const noexcept {
+        return id;
+    }
+private:
+    id_type id;
+};
+
+namespace {
+
+struct Options {
+    std::size_t nodes = 1000000;
+    // Mean number of publications each new one cites.
+    double citations = 4;
+    // Chance that a new publication also cites the one created just before
+    // it, which grows long chains.
+    double chain = 0.3;
+    std::uint64_t seed = 1;
+    std::size_t queries = 1000000;
+    std::string index = "hash";
+    std::string format = "json";
+};
+
+// Preferential attachment: a publication is cited with probability
+// proportional to the citations it already has (plus one), which yields a
+// power-law in-degree with a few heavily cited hubs. Publication 0 is the
+// root; every other cites at least one earlier publication, so the result
+// is a DAG in creation order.
+class Generator {
+public:
+    Generator(Options const &options) : options(options), random(options.seed) {
+    }
+
+    std::vector<Publication::id_type> parents_of(Publication::id_type id) {
+        std::vector<Publication::id_type> parents;
+        if (std::bernoulli_distribution(options.chain)(random))
+            parents.push_back(id - 1);
+        std::geometric_distribution<std::size_t> extra(1 / std::max(options.citations, 1.0));
+        std::size_t count = std::min<std::size_t>(1 + extra(random), id);
+        while (parents.size() < count)
+            parents.push_back(pick());
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+        for (auto parent : parents)
+            endpoints.push_back(parent);
+        endpoints.push_back(id);
+        return parents;
+    }
+
+    // An earlier publication, preferentially a well-cited one.
+    Publication::id_type pick() {
+        if (endpoints.empty())
+            return 0;
+        return endpoints[std::uniform_int_distribution<std::size_t>(0, endpoints.size() - 1)(random)];
+    }
+
+    std::mt19937_64 &engine() {
+        return random;
+    }
+
+private:
+    Options options;
+    std::mt19937_64 random;
+    std::vector<Publication::id_type> endpoints {0};
+};
+
+class Report {
+public:
+    Report(Options const &options) : options(options) {
+        if (options.format == "csv")
+            std::cout << "op,index,nodes,count,seconds,ops_per_second,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n";
+    }
+
+    void add(char const *op, std::vector<std::uint64_t> latencies, double seconds) {
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&latencies](double p) -> std::uint64_t {
+            if (latencies.empty())
+                return 0;
+            return latencies[std::min(latencies.size() - 1, std::size_t(p * double(latencies.size())))];
+        };
+        std::size_t count = latencies.size();
+        double rate = seconds > 0 ? double(count) / seconds : 0;
+        std::uint64_t max = latencies.empty() ? 0 : latencies.back();
+        if (options.format == "csv") {
+            std::cout << op << ',' << options.index << ',' << options.nodes << ',' << count << ',' << seconds
+                      << ',' << rate << ',' << percentile(0.5) << ',' << percentile(0.9) << ','
+                      << percentile(0.99) << ',' << percentile(0.999) << ',' << max << '\n';
+        } else {
+            std::cout << "{\"op\":\"" << op << "\",\"index\":\"" << options.index << "\",\"nodes\":"
+                      << options.nodes << ",\"count\":" << count << ",\"seconds\":" << seconds
+                      << ",\"ops_per_second\":" << rate << ",\"p50_ns\":" << percentile(0.5)
+                      << ",\"p90_ns\":" << percentile(0.9) << ",\"p99_ns\":" << percentile(0.99)
+                      << ",\"p999_ns\":" << percentile(0.999) << ",\"max_ns\":" << max << "}\n";
+        }
+    }
+
+    // A derived figure, such as a speedup over a baseline run.
+    void ratio(char const *op, double value) {
+        if (options.format == "csv")
+            std::cout << op << ',' << options.index << ',' << options.nodes << ',' << value << ",,,,,,,\n";
+        else
+            std::cout << "{\"op\":\"" << op << "\",\"index\":\"" << options.index << "\",\"nodes\":"
+                      << options.nodes << ",\"ratio\":" << value << "}\n";
+    }
+
+    void finish() {
+        long peak = peak_rss_kib();
+        if (options.format == "csv")
+            std::cout << "peak_rss_kib," << options.index << ',' << options.nodes << ',' << peak << ",,,,,,,\n";
+        else
+            std::cout << "{\"op\":\"peak_rss\",\"index\":\"" << options.index << "\",\"nodes\":"
+                      << options.nodes << ",\"peak_rss_kib\":" << peak << "}\n";
+    }
+
+private:
+    static long peak_rss_kib() {
+#if defined(__unix__) || defined(__APPLE__)
+        rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#else
+        return -1;
+#endif
+    }
+
+    Options options;
+};
+
+using Clock = std::chrono::steady_clock;
+
+std::uint64_t nanoseconds(Clock::duration d) {
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+double seconds(Clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+// Collects the latency of each timed call; only timed work counts towards
+// the reported total, so workload generation does not skew throughput.
+class Stopwatch {
+public:
+    explicit Stopwatch(std::size_t expected) {
+        latencies.reserve(expected);
+    }
+
+    template <class Op>
+    void time(Op &&op) {
+        Clock::time_point before = Clock::now();
+        op();
+        Clock::duration elapsed = Clock::now() - before;
+        total += elapsed;
+        latencies.push_back(nanoseconds(elapsed));
+    }
+
+    void report(Report &to, char const *name) {
+        to.add(name, std::move(latencies), seconds(total));
+    }
+
+private:
+    std::vector<std::uint64_t> latencies;
+    Clock::duration total {};
+};
+
+// Runs op(i, stopwatch) for i in [0, count).
+template <class Op>
+void measure(Report &report, char const *name, std::size_t count, Op &&op) {
+    Stopwatch stopwatch(count);
+    for (std::size_t i = 0; i < count; ++i)
+        op(i, stopwatch);
+    stopwatch.report(report, name);
+}
+
+template <class IndexPolicy>
+void run(Options const &options) {
+    using Graph = CitationGraph<Publication, IndexPolicy>;
+    Report report(options);
+    Generator generator(options);
+    std::size_t volatile sink = 0;
+
+    std::optional<Graph> graph;
+    graph.emplace(0);
+    measure(report, "create", options.nodes - 1, [&](std::size_t i, Stopwatch &stopwatch) {
+        Publication::id_type id = i + 1;
+        std::vector<Publication::id_type> parents = generator.parents_of(id);
+        stopwatch.time([&]() { graph -> create(id, parents); });
+    });
+
+    std::size_t extra = options.nodes / 4;
+    measure(report, "add_citation", extra, [&](std::size_t, Stopwatch &stopwatch) {
+        Publication::id_type child = 1 + generator.engine()() % (options.nodes - 1);
+        Publication::id_type parent = generator.engine()() % child;
+        stopwatch.time([&]() { graph -> add_citation(child, parent); });
+    });
+
+    std::vector<Publication::id_type> probes(options.queries);
+    for (auto &probe : probes)
+        probe = generator.pick();
+    measure(report, "get_children", options.queries, [&](std::size_t i, Stopwatch &stopwatch) {
+        stopwatch.time([&]() { sink = sink + graph -> get_children(probes[i]).size(); });
+    });
+    measure(report, "get_parents", options.queries, [&](std::size_t i, Stopwatch &stopwatch) {
+        stopwatch.time([&]() { sink = sink + graph -> get_parents(probes[i]).size(); });
+    });
+    measure(report, "exists", options.queries, [&](std::size_t i, Stopwatch &stopwatch) {
+        // Every other probe misses.
+        Publication::id_type probe = i % 2 ? probes[i] : probes[i] + options.nodes;
+        stopwatch.time([&]() { sink = sink + graph -> exists(probe); });
+    });
+
+    // Random victims; a removal takes along whatever only it kept alive.
+    std::size_t removals = std::min<std::size_t>(options.nodes / 100, 10000);
+    measure(report, "remove", removals, [&](std::size_t, Stopwatch &stopwatch) {
+        Publication::id_type victim = 1 + generator.engine()() % (options.nodes - 1);
+        if (graph -> exists(victim))
+            stopwatch.time([&]() { graph -> remove(victim); });
+    });
+
+    measure(report, "destroy", 1, [&](std::size_t, Stopwatch &stopwatch) {
+        stopwatch.time([&]() { graph.reset(); });
+    });
+
+    // One chain as long as the whole graph, removed from its head: the
+    // cascade must not recurse however deep it goes.
+    graph.emplace(0);
+    for (Publication::id_type id = 1; id < options.nodes; ++id)
+        graph -> create(id, id - 1);
+    measure(report, "remove_deep_chain", 1, [&](std::size_t, Stopwatch &stopwatch) {
+        stopwatch.time([&]() { graph -> remove(1); });
+    });
+    graph.reset();
+
+    // One hub cited by everything else, losing a quarter of its citations
+    // one removal at a time, in random order.
+    graph.emplace(0);
+    for (Publication::id_type id = 1; id < options.nodes; ++id)
+        graph -> create(id, 0);
+    std::vector<Publication::id_type> leaves(options.nodes - 1);
+    for (std::size_t i = 0; i < leaves.size(); ++i)
+        leaves[i] = i + 1;
+    std::shuffle(leaves.begin(), leaves.end(), generator.engine());
+    measure(report, "remove_hub_children", leaves.size() / 4, [&](std::size_t i, Stopwatch &stopwatch) {
+        stopwatch.time([&]() { graph -> remove(leaves[i]); });
+    });
+    // And another quarter in a single call.
+    std::vector<Publication::id_type> batch(leaves.begin() + std::ptrdiff_t(leaves.size() / 4),
+                                            leaves.begin() + std::ptrdiff_t(leaves.size() / 2));
+    measure(report, "remove_many_hub_children", 1, [&](std::size_t, Stopwatch &stopwatch) {
+        stopwatch.time([&]() { graph -> remove_many(batch); });
+    });
+    graph.reset();
+
+    // Publishing to readers after each single mutation, which must cost the
+    // same however large the graph is.
+    {
+        Generator shape(options);
+        Graph built(0);
+        for (Publication::id_type id = 1; id < options.nodes; ++id)
+            built.create(id, shape.parents_of(id));
+        ConcurrentCitationGraph<Publication, IndexPolicy> shared(std::move(built));
+        std::size_t publishes = 1000;
+        Publication::id_type fresh = options.nodes;
+        measure(report, "publish_create", publishes, [&](std::size_t, Stopwatch &stopwatch) {
+            std::vector<Publication::id_type> parents = shape.parents_of(fresh);
+            stopwatch.time([&]() { shared.create(fresh, parents); });
+            ++fresh;
+        });
+        measure(report, "publish_add_citation", publishes, [&](std::size_t, Stopwatch &stopwatch) {
+            Publication::id_type child = 1 + shape.engine()() % (fresh - 1);
+            Publication::id_type parent = shape.engine()() % child;
+            stopwatch.time([&]() { shared.add_citation(child, parent); });
+        });
+        measure(report, "publish_remove", publishes, [&](std::size_t, Stopwatch &stopwatch) {
+            Publication::id_type victim = 1 + shape.engine()() % (fresh - 1);
+            if (shared.snapshot().exists(victim))
+                stopwatch.time([&]() { shared.remove(victim); });
+        });
+    }
+
+    // Writers ingesting into shards at once. Each publication cites the
+    // writer's previous one and a random earlier one of the same writer;
+    // ids are hashed over the shards, so writers only meet by chance. Only
+    // a writer's first publication cites the root. Scaling is throughput
+    // relative to one writer.
+    char const *ingests[] = {"sharded_ingest_1_writer", "sharded_ingest_2_writers", "sharded_ingest_4_writers",
+                             "sharded_ingest_8_writers", "sharded_ingest_16_writers"};
+    char const *scalings[] = {"sharded_scaling_1_writer", "sharded_scaling_2_writers", "sharded_scaling_4_writers",
+                              "sharded_scaling_8_writers", "sharded_scaling_16_writers"};
+    double single = 0;
+    for (std::size_t k = 0; k < 5; ++k) {
+        std::size_t writers = std::size_t(1) << k;
+        ShardedCitationGraph<Publication, IndexPolicy> ingest(0, 64);
+        std::vector<std::vector<std::uint64_t> > latencies(writers);
+        std::vector<std::thread> threads;
+        Clock::time_point before = Clock::now();
+        for (std::size_t w = 0; w < writers; ++w) {
+            threads.emplace_back([&ingest, &latencies, &options, writers, w]() {
+                std::size_t count = (options.nodes - 1) / writers;
+                std::mt19937_64 random(options.seed + w);
+                std::vector<Publication::id_type> own;
+                own.reserve(count);
+                latencies[w].reserve(count);
+                std::vector<Publication::id_type> parents;
+                for (std::size_t i = 0; i < count; ++i) {
+                    Publication::id_type id = 1 + w + i * writers;
+                    parents.clear();
+                    if (own.empty()) {
+                        parents.push_back(0);
+                    } else {
+                        parents.push_back(own.back());
+                        parents.push_back(own[std::uniform_int_distribution<std::size_t>(0, own.size() - 1)(random)]);
+                    }
+                    Clock::time_point start = Clock::now();
+                    ingest.create(id, parents);
+                    latencies[w].push_back(nanoseconds(Clock::now() - start));
+                    own.push_back(id);
+                }
+            });
+        }
+        for (auto &thread : threads)
+            thread.join();
+        double elapsed = seconds(Clock::now() - before);
+        std::vector<std::uint64_t> all;
+        for (auto &part : latencies)
+            all.insert(all.end(), part.begin(), part.end());
+        double rate = elapsed > 0 ? double(all.size()) / elapsed : 0;
+        if (k == 0)
+            single = rate;
+        report.add(ingests[k], std::move(all), elapsed);
+        report.ratio(scalings[k], single > 0 ? rate / single : 0);
+    }
+
+    report.finish();
+}
+
+bool parse(int argc, char **argv, Options &options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        char const *flag = argv[i];
+        char const *value = argv[i + 1];
+        if (std::strcmp(flag, "--nodes") == 0)
+            options.nodes = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(flag, "--citations") == 0)
+            options.citations = std::strtod(value, nullptr);
+        else if (std::strcmp(flag, "--chain") == 0)
+            options.chain = std::strtod(value, nullptr);
+        else if (std::strcmp(flag, "--seed") == 0)
+            options.seed = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(flag, "--queries") == 0)
+            options.queries = std::strtoull(value, nullptr, 10);
+        else if (std::strcmp(flag, "--index") == 0)
+            options.index = value;
+        else if (std::strcmp(flag, "--format") == 0)
+            options.format = value;
+        else
+            return false;
+    }
+    return argc % 2 == 1 && options.nodes >= 2 && options.chain >= 0 && options.chain <= 1
+           && (options.index == "ordered" || options.index == "hash" || options.index == "dense")
+           && (options.format == "json" || options.format == "csv");
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--nodes N] [--citations C] [--chain P] [--seed S]"
+                  << " [--queries Q] [--index ordered|hash|dense] [--format json|csv]\n";
+        return 2;
+    }
+    if (options.index == "ordered")
+        run<OrderedIdIndex>(options);
+    else if (options.index == "hash")
+        run<HashIdIndex<> >(options);
+    else
+        run<DenseIdIndex>(options);
+}
@@ -0,0 +1,590 @@
+#ifndef CITATION_GRAPH_CONCURRENT_H
+#define CITATION_GRAPH_CONCURRENT_H
+
+#include "citation_graph.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace citation_graph_detail {
+
+// Shared pointers by slot, in a trie of 64-way nodes. A change copies the
+// nodes on its path and shares every other node with the trie it started
+// from, so versions that differ in a few slots cost a few nodes each.
+template <class T>
+class persistent_slots {
+    struct node {
+        // Leaves hold T, inner nodes hold node.
+        std::array<std::shared_ptr<void const>, 64> items;
+    };
+
+public:
+    T const *find(std::uint32_t slot) const noexcept {
+        if (!fits(slot, levels))
+            return nullptr;
+        void const *at = root.get();
+        for (unsigned level = levels; at && level-- > 0;)
+            at = static_cast<node const *>(at) -> items[(std::uint64_t(slot) >> (6 * level)) & 63].get();
+        return static_cast<T const *>(at);
+    }
+
+    // Calls visit(slot, value) for every slot that holds a value, in
+    // ascending slot order.
+    template <class Visit>
+    void for_each(Visit &&visit) const {
+        visit_node(root.get(), levels, 0, visit);
+    }
+
+    // Changes a copy; every node is copied at most once per editor.
+    class editor {
+    public:
+        explicit editor(persistent_slots const &from) : result(from) {}
+
+        void set(std::uint32_t slot, std::shared_ptr<T const> value) {
+            while (!fits(slot, result.levels)) {
+                auto top = std::make_shared<node>();
+                top -> items[0] = std::move(result.root);
+                fresh.insert(top.get());
+                result.root = std::move(top);
+                ++result.levels;
+            }
+            node *at = own(result.root);
+            for (unsigned level = result.levels - 1; level > 0; --level)
+                at = own(at -> items[(std::uint64_t(slot) >> (6 * level)) & 63]);
+            at -> items[slot & 63] = std::move(value);
+        }
+
+        persistent_slots finish() noexcept {
+            return std::move(result);
+        }
+
+    private:
+        persistent_slots result;
+        std::unordered_set<void const *> fresh;
+
+        node *own(std::shared_ptr<void const> &link) {
+            if (!link || !fresh.count(link.get())) {
+                auto copy = link ? std::make_shared<node>(*static_cast<node const *>(link.get()))
+                                 : std::make_shared<node>();
+                fresh.insert(copy.get());
+                link = std::move(copy);
+            }
+            return const_cast<node *>(static_cast<node const *>(link.get()));
+        }
+    };
+
+private:
+    std::shared_ptr<void const> root;
+    unsigned levels = 1;
+
+    static bool fits(std::uint32_t slot, unsigned levels) noexcept {
+        return levels >= 6 || (std::uint64_t(slot) >> (6 * levels)) == 0;
+    }
+
+    template <class Visit>
+    static void visit_node(void const *at, unsigned level, std::uint64_t first, Visit &visit) {
+        if (!at)
+            return;
+        auto const &items = static_cast<node const *>(at) -> items;
+        for (std::uint64_t i = 0; i < 64; ++i) {
+            if (level == 1) {
+                if (items[i])
+                    visit(std::uint32_t(first + i), *static_cast<T const *>(items[i].get()));
+            } else {
+                visit_node(items[i].get(), level - 1, (first + i) << 6, visit);
+            }
+        }
+    }
+};
+
+// Slots by key in a treap, persistent like persistent_slots: a change copies
+// the O(log n) nodes on its path. Priorities are hashed from the slot, so
+// the shape does not depend on the order of changes.
+template <class Key>
+class persistent_index {
+    struct node {
+        Key key;
+        std::uint32_t slot;
+        std::uint64_t priority;
+        std::shared_ptr<node const> left;
+        std::shared_ptr<node const> right;
+    };
+    using link = std::shared_ptr<node const>;
+
+public:
+    std::optional<std::uint32_t> find(Key const &key) const {
+        for (node const *at = root.get(); at;) {
+            if (key < at -> key)
+                at = at -> left.get();
+            else if (at -> key < key)
+                at = at -> right.get();
+            else
+                return at -> slot;
+        }
+        return std::nullopt;
+    }
+
+    // key must not be present.
+    persistent_index insert(Key const &key, std::uint32_t slot) const {
+        persistent_index result;
+        result.root = insert(root, key, slot, mix64(std::uint64_t(slot) + 1));
+        return result;
+    }
+
+    persistent_index erase(Key const &key) const {
+        persistent_index result;
+        result.root = erase(root, key);
+        return result;
+    }
+
+private:
+    link root;
+
+    static link with(node const &at, link left, link right) {
+        return std::make_shared<node const>(node {at.key, at.slot, at.priority, std::move(left), std::move(right)});
+    }
+
+    // Into keys below key and keys above it.
+    static std::pair<link, link> split(link const &at, Key const &key) {
+        if (!at)
+            return {};
+        if (at -> key < key) {
+            auto right = split(at -> right, key);
+            return {with(*at, at -> left, std::move(right.first)), std::move(right.second)};
+        }
+        auto left = split(at -> left, key);
+        return {std::move(left.first), with(*at, std::move(left.second), at -> right)};
+    }
+
+    static link merge(link const &low, link const &high) {
+        if (!low)
+            return high;
+        if (!high)
+            return low;
+        if (low -> priority > high -> priority)
+            return with(*low, low -> left, merge(low -> right, high));
+        return with(*high, merge(low, high -> left), high -> right);
+    }
+
+    static link insert(link const &at, Key const &key, std::uint32_t slot, std::uint64_t priority) {
+        if (!at || priority > at -> priority) {
+            auto halves = split(at, key);
+            return std::make_shared<node const>(node {key, slot, priority, std::move(halves.first),
+                                                      std::move(halves.second)});
+        }
+        if (key < at -> key)
+            return with(*at, insert(at -> left, key, slot, priority), at -> right);
+        return with(*at, at -> left, insert(at -> right, key, slot, priority));
+    }
+
+    static link erase(link const &at, Key const &key) {
+        if (!at)
+            return at;
+        if (key < at -> key)
+            return with(*at, erase(at -> left, key), at -> right);
+        if (at -> key < key)
+            return with(*at, at -> left, erase(at -> right, key));
+        return merge(at -> left, at -> right);
+    }
+};
+
+} // namespace citation_graph_detail
+
+// A CitationGraph shared between any number of reader threads and writers
+// taking turns. Readers call snapshot() and query the version they get for
+// as long as they hold it; they never wait for a mutation and never see one
+// half done. Writers apply updates to a private working copy and then
+// publish the next version with one atomic pointer store. Old versions are
+// freed by whoever drops the last reference to them.
+//
+// Versions are persistent: each shares everything an update did not touch
+// with the one before it, so publishing copies only the publications the
+// update created, removed or changed the citations of, plus O(log n) index
+// nodes each. Such a publication's citation lists are copied whole, so
+// citing or removing a publication cited d times costs O(d) time and memory
+// for its record; an update() copies each record once, however many of its
+// citations change, so batch changes around heavily cited publications.
+// Publication needs a copy
+// constructor; a publication is copied when it is created, so changing one
+// in place through the working copy's operator[] is not published.
+template <class Publication, class IndexPolicy = DefaultIdIndex<typename Publication::id_type>,
+          class StatsPolicy = NoCitationStats>
+class ConcurrentCitationGraph {
+public:
+    using graph_type = CitationGraph<Publication, IndexPolicy, StatsPolicy>;
+    using id_type = typename Publication::id_type;
+
+private:
+    struct record {
+        std::shared_ptr<Publication const> publication;
+        id_type id;
+        std::uint32_t generation;
+        // Slots, ascending.
+        std::vector<std::uint32_t> children;
+        std::vector<std::uint32_t> parents;
+    };
+
+    struct version {
+        citation_graph_detail::persistent_slots<record> records;
+        citation_graph_detail::persistent_index<id_type> slots;
+        std::uint32_t root = 0;
+        std::uint64_t number = 0;
+        typename graph_type::MemoryStats memory {};
+        CitationGraphStats stats;
+    };
+
+public:
+    // One immutable version; any number of threads may share a snapshot.
+    class Snapshot {
+    public:
+        // Read-only range over the ids of a publication's children or
+        // parents, valid for as long as the snapshot is.
+        class NeighborView {
+        public:
+            class iterator {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = id_type;
+                using difference_type = std::ptrdiff_t;
+                using pointer = id_type const *;
+                using reference = id_type const &;
+
+                iterator() = default;
+
+                reference operator*() const noexcept {
+                    return records -> find(*position) -> id;
+                }
+                pointer operator->() const noexcept {
+                    return &**this;
+                }
+                iterator &operator++() noexcept {
+                    ++position;
+                    return *this;
+                }
+                iterator operator++(int) noexcept {
+                    iterator previous = *this;
+                    ++position;
+                    return previous;
+                }
+                bool operator==(iterator const &other) const noexcept {
+                    return position == other.position;
+                }
+                bool operator!=(iterator const &other) const noexcept {
+                    return position != other.position;
+                }
+
+            private:
+                friend class NeighborView;
+                iterator(std::uint32_t const *position,
+                         citation_graph_detail::persistent_slots<record> const *records) noexcept
+                        : position(position), records(records) {}
+
+                std::uint32_t const *position = nullptr;
+                citation_graph_detail::persistent_slots<record> const *records = nullptr;
+            };
+
+            iterator begin() const noexcept {
+                return iterator(neighbors -> data(), records);
+            }
+            iterator end() const noexcept {
+                return iterator(neighbors -> data() + neighbors -> size(), records);
+            }
+            std::size_t size() const noexcept {
+                return neighbors -> size();
+            }
+            bool empty() const noexcept {
+                return neighbors -> empty();
+            }
+
+        private:
+            friend class Snapshot;
+            NeighborView(std::vector<std::uint32_t> const *neighbors,
+                         citation_graph_detail::persistent_slots<record> const *records) noexcept
+                    : neighbors(neighbors), records(records) {}
+
+            std::vector<std::uint32_t> const *neighbors;
+            citation_graph_detail::persistent_slots<record> const *records;
+        };
+
+        // Counts published updates; the initial graph is version 0.
+        std::uint64_t number() const noexcept {
+            return current -> number;
+        }
+
+        id_type get_root_id() const {
+            return current -> records.find(current -> root) -> id;
+        }
+
+        bool exists(id_type const &id) const {
+            return current -> slots.find(id).has_value();
+        }
+
+        std::vector<id_type> get_children(id_type const &id) const {
+            return ids_of(locate(id).children);
+        }
+
+        std::vector<id_type> get_parents(id_type const &id) const {
+            return ids_of(locate(id).parents);
+        }
+
+        NeighborView children_view(id_type const &id) const {
+            return NeighborView(&locate(id).children, &current -> records);
+        }
+
+        NeighborView parents_view(id_type const &id) const {
+            return NeighborView(&locate(id).parents, &current -> records);
+        }
+
+        std::size_t citation_count(id_type const &id) const {
+            return locate(id).children.size();
+        }
+
+        std::size_t reference_count(id_type const &id) const {
+            return locate(id).parents.size();
+        }
+
+        Publication const &operator[](id_type const &id) const {
+            return *locate(id).publication;
+        }
+
+        // Versions keep no order, so this and compress() sort the version
+        // they are called on, in O(n + m).
+        std::vector<id_type> topological_order() const {
+            std::vector<std::uint32_t> order = sorted_slots();
+            std::vector<id_type> result;
+            result.reserve(order.size());
+            for (auto slot : order)
+                result.push_back(current -> records.find(slot) -> id);
+            return result;
+        }
+
+        CompressedCitationGraph<id_type> compress() const {
+            std::vector<std::uint32_t> slots = sorted_slots();
+            std::vector<std::uint32_t> position(slots.empty() ? 0 : *std::max_element(slots.begin(), slots.end()) + 1);
+            for (std::size_t i = 0; i < slots.size(); ++i)
+                position[slots[i]] = std::uint32_t(i);
+
+            CompressedCitationGraph<id_type> result;
+            result.ids.reserve(slots.size());
+            result.child_offsets.reserve(slots.size() + 1);
+            result.parent_offsets.reserve(slots.size() + 1);
+            result.children.reserve(current -> memory.citations);
+            result.parents.reserve(current -> memory.citations);
+            auto append = [&position](std::vector<std::uint32_t> &out, std::vector<std::uint32_t> const &neighbors) {
+                std::size_t first = out.size();
+                for (auto neighbor : neighbors)
+                    out.push_back(position[neighbor]);
+                std::sort(out.begin() + first, out.end());
+            };
+            result.child_offsets.push_back(0);
+            result.parent_offsets.push_back(0);
+            for (auto slot : slots) {
+                record const &at = *current -> records.find(slot);
+                result.ids.push_back(at.id);
+                append(result.children, at.children);
+                result.child_offsets.push_back(result.children.size());
+                append(result.parents, at.parents);
+                result.parent_offsets.push_back(result.parents.size());
+            }
+            return result;
+        }
+
+        // The working copy's, as this version was published.
+        typename graph_type::MemoryStats memory_stats() const noexcept {
+            return current -> memory;
+        }
+
+        CitationGraphStats stats() const noexcept {
+            return current -> stats;
+        }
+
+    private:
+        friend class ConcurrentCitationGraph;
+
+        explicit Snapshot(std::shared_ptr<version const> current) noexcept
+                : current(std::move(current)) {}
+
+        std::shared_ptr<version const> current;
+
+        record const &locate(id_type const &id) const {
+            auto slot = current -> slots.find(id);
+            if (!slot)
+                throw PublicationNotFound();
+            return *current -> records.find(*slot);
+        }
+
+        std::vector<id_type> ids_of(std::vector<std::uint32_t> const &slots) const {
+            std::vector<id_type> result;
+            result.reserve(slots.size());
+            for (auto slot : slots)
+                result.push_back(current -> records.find(slot) -> id);
+            return result;
+        }
+
+        // Kahn's algorithm over the records.
+        std::vector<std::uint32_t> sorted_slots() const {
+            std::vector<std::uint32_t> order;
+            std::vector<std::pair<std::uint32_t, std::size_t> > pending;
+            order.reserve(current -> memory.live_publications);
+            current -> records.for_each([&](std::uint32_t slot, record const &at) {
+                if (at.parents.empty())
+                    order.push_back(slot);
+                else
+                    pending.emplace_back(slot, at.parents.size());
+            });
+            auto waiting = [&pending](std::uint32_t slot) -> std::size_t & {
+                return std::lower_bound(pending.begin(), pending.end(), std::make_pair(slot, std::size_t(0))) -> second;
+            };
+            for (std::size_t next = 0; next < order.size(); ++next) {
+                for (auto child : current -> records.find(order[next]) -> children) {
+                    if (--waiting(child) == 0)
+                        order.push_back(child);
+                }
+            }
+            return order;
+        }
+    };
+
+    explicit ConcurrentCitationGraph(id_type const &stem_id)
+            : ConcurrentCitationGraph(graph_type(stem_id)) {}
+
+    explicit ConcurrentCitationGraph(graph_type &&graph) : working(std::move(graph)) {
+        std::vector<index_type> all;
+        all.reserve(working.nodes.size());
+        for (index_type slot = 0; slot < working.nodes.size(); ++slot)
+            all.push_back(slot);
+        auto first = std::make_shared<version>(advance(version(), all));
+        first -> root = working.root;
+        first -> number = 0;
+        stamp(*first);
+        published = std::move(first);
+    }
+
+    ConcurrentCitationGraph(ConcurrentCitationGraph const &) = delete;
+    ConcurrentCitationGraph &operator=(ConcurrentCitationGraph const &) = delete;
+
+    Snapshot snapshot() const {
+        return Snapshot(std::atomic_load(&published));
+    }
+
+    // Runs update(graph) on the working copy, inside a transaction of it,
+    // and publishes the result as one new version. If update or publishing
+    // throws, the transaction is rolled back and nothing is published, so a
+    // batch is all or nothing. As in any transaction, cycles are looked for
+    // once update returns, and citing against the topological order makes
+    // the commit recompute it in O(n + m); update must not begin a
+    // transaction of its own.
+    template <class Update>
+    void update(Update &&update) {
+        std::lock_guard<std::mutex> lock(writer);
+        auto transaction = working.begin_transaction();
+        update(working);
+        auto next = std::make_shared<version>(advance(*published, working.transaction_slots()));
+        transaction.commit();
+        publish(std::move(next));
+    }
+
+    template <class... Args>
+    void create(Args const &... args) {
+        update([&](graph_type &graph) { graph.create(args...); });
+    }
+
+    // Outside a transaction, so that a citation against the order costs the
+    // graph's incremental reordering only.
+    template <class Child, class Parent>
+    void add_citation(Child const &child_id, Parent const &parent_id) {
+        std::lock_guard<std::mutex> lock(writer);
+        index_type child = working.locate(child_id);
+        index_type parent = working.locate(parent_id);
+        // Already cited: nothing changes, so nothing is published.
+        if (working.nodes[child].parents.contains(parent))
+            return;
+        auto next = std::make_shared<version>(*published);
+        typename citation_graph_detail::persistent_slots<record>::editor records(published -> records);
+        auto cite = [&](index_type slot, std::vector<std::uint32_t> record::*list, index_type other) {
+            auto changed = std::make_shared<record>(*published -> records.find(slot));
+            auto &neighbors = (*changed).*list;
+            neighbors.insert(std::lower_bound(neighbors.begin(), neighbors.end(), other), other);
+            records.set(slot, std::move(changed));
+        };
+        cite(child, &record::parents, parent);
+        cite(parent, &record::children, child);
+        next -> records = records.finish();
+        working.add_citation(child_id, parent_id);
+        publish(std::move(next));
+    }
+
+    template <class Key>
+    void remove(Key const &id) {
+        update([&](graph_type &graph) { graph.remove(id); });
+    }
+
+private:
+    using index_type = std::uint32_t;
+
+    std::mutex writer;
+    graph_type working;
+    // Replaced only through std::atomic_store under the writer lock, and read
+    // elsewhere only through std::atomic_load.
+    std::shared_ptr<version const> published;
+
+    // from, with the records of the given working slots brought up to date.
+    version advance(version const &from, std::vector<index_type> touched) const {
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        version next = from;
+        typename citation_graph_detail::persistent_slots<record>::editor records(from.records);
+        auto live = [this](index_type slot) {
+            return working.nodes[slot].publication && !working.nodes[slot].parked;
+        };
+        auto kept = [&](record const *old, index_type slot) {
+            return old && live(slot) && old -> generation == working.nodes[slot].generation;
+        };
+        // Gone ids first, in case one came back in another slot.
+        for (auto slot : touched) {
+            record const *old = from.records.find(slot);
+            if (old && !kept(old, slot))
+                next.slots = next.slots.erase(old -> id);
+        }
+        for (auto slot : touched) {
+            record const *old = from.records.find(slot);
+            if (!live(slot)) {
+                if (old)
+                    records.set(slot, nullptr);
+                continue;
+            }
+            auto const &node = working.nodes[slot];
+            bool same = kept(old, slot);
+            auto fresh = std::make_shared<record>(record {
+                    same ? old -> publication : std::make_shared<Publication const>(*node.publication),
+                    node.id(), node.generation,
+                    std::vector<std::uint32_t>(node.children.begin(), node.children.end()),
+                    std::vector<std::uint32_t>(node.parents.begin(), node.parents.end())});
+            records.set(slot, std::move(fresh));
+            if (!same)
+                next.slots = next.slots.insert(node.id(), slot);
+        }
+        next.records = records.finish();
+        return next;
+    }
+
+    void stamp(version &next) const noexcept {
+        next.memory = working.memory_stats();
+        next.stats = working.stats();
+    }
+
+    void publish(std::shared_ptr<version> next) noexcept {
+        next -> number = published -> number + 1;
+        stamp(*next);
+        std::atomic_store(&published, std::shared_ptr<version const>(std::move(next)));
+    }
+};
+
+#endif //CITATION_GRAPH_CONCURRENT_H
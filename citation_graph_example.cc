@@ -1,9 +1,23 @@
 #include "citation_graph.h"
+#include "citation_graph_concurrent.h"
+#include "citation_graph_loader.h"
+#include "citation_graph_log.h"
+#include "citation_graph_rank.h"
+#include "citation_graph_sharded.h"
+#include "citation_graph_traverse.h"
 
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <exception>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory_resource>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 #include <cstdlib>
 #include <ctime>
@@ -410,4 +424,1100 @@ int main() {
             assert(false);
         } catch (...) {}
     }
+
+    {
+        CitationGraph<Publication> gen("A");
+        Publication &root = gen["A"];
+        for (int i = 0; i < 2000; ++i)
+            gen.create(std::to_string(i), "A");
+        assert(&root == &gen["A"]);
+        assert(gen.get_children("A").size() == 2000);
+        gen.remove("1000");
+        assert(gen.get_children("A").size() == 1999);
+    }
+
+    {
+        CitationGraph<Publication> gen("A");
+        std::string previous = "A";
+        for (int i = 0; i < 300000; ++i) {
+            std::string next = std::to_string(i);
+            gen.create(next, previous);
+            previous = next;
+        }
+        gen.create("X", "A");
+        gen.create("Y", std::vector<Publication::id_type>{"X", "5"});
+        assert(gen.remove_many({"0", "X", "0"}) == 300002);
+        assert(!gen.exists("299999"));
+        assert(!gen.exists("Y"));
+        assert(gen.get_children("A").empty());
+        try {
+            gen.create("B", "A");
+            gen.remove_many({"B", "A"});
+            assert(false);
+        } catch (TriedToRemoveRoot &) {
+            assert(gen.exists("B"));
+        }
+    }
+
+    {
+        CitationGraph<Publication> gen("A");
+        for (int round = 0; round < 100; ++round) {
+            gen.create("B", "A");
+            gen.create("C", "B");
+            gen.add_citation("C", "A");
+            gen.remove("B");
+            assert(gen.exists("C"));
+            gen.remove("C");
+        }
+        auto stats = gen.memory_stats();
+        assert(stats.live_publications == 1);
+        assert(stats.dead_index_entries == 0);
+        assert(stats.arena_slots <= 3);
+        assert(stats.citations == 0);
+    }
+
+    {
+        CitationGraph<Publication, HashIdIndex<> > gen("A");
+        for (int i = 0; i < 1000; ++i)
+            gen.create(std::to_string(i), i % 3 == 0 ? "A" : std::to_string(i / 3));
+        std::string_view view = "42";
+        assert(gen.exists(view));
+        assert(gen.get_parents("43") == std::vector<Publication::id_type>{"14"});
+        assert(gen.remove_many({"3", "6"}) > 2);
+        assert(!gen.exists("3"));
+        assert(!gen.exists(std::string_view("10")));
+        gen.create("3", "A");
+        assert(gen["3"].get_id() == "3");
+        assert(gen.memory_stats().dead_index_entries == 0);
+    }
+
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "A");
+        gen.create("D", std::vector<Publication::id_type>{"B", "C"});
+        std::vector<Publication::id_type> seen;
+        for (auto const &child : gen.children_view("A"))
+            seen.push_back(child);
+        assert(seen == gen.get_children("A"));
+        assert(gen.parents_view("D").size() == 2);
+        assert(gen.parents_view("A").empty());
+        std::size_t visited = 0;
+        gen.for_each_parent("D", [&visited](Publication::id_type const &parent) {
+            assert(parent == "B" || parent == "C");
+            ++visited;
+        });
+        gen.for_each_child("D", [](Publication::id_type const &) { assert(false); });
+        assert(visited == 2);
+    }
+
+    {
+        // get_id() returns a reference, so views hand out the publication's
+        // own id instead of a copy kept beside it.
+        class Article {
+        public:
+            typedef std::string id_type;
+            Article(id_type const &id) : id(id) {
+            }
+            id_type const &get_id() const noexcept {
+                return id;
+            }
+        private:
+            id_type id;
+        };
+        CitationGraph<Article, HashIdIndex<> > gen("A");
+        gen.create("B", "A");
+        gen.create("C", "B");
+        assert(&*gen.children_view("A").begin() == &gen["B"].get_id());
+        assert(gen.get_parents("C") == std::vector<Article::id_type>{"B"});
+        auto copy = gen.clone();
+        gen.remove("B");
+        assert(!gen.exists("C") && copy.get_children("B") == std::vector<Article::id_type>{"C"});
+        gen.create("B", "A");
+        assert(gen.id_of(gen.key_of("B")) == "B");
+    }
+
+    {
+        CitationGraph<Publication> gen("A");
+        auto root = gen.find("A");
+        auto b = gen.create("B", "A");
+        auto c = gen.create("C", std::vector<CitationGraph<Publication>::NodeHandle>{root, b});
+        assert(gen.find("C") == c);
+        assert(!gen.find("Z"));
+        gen.create("D", "A");
+        gen.add_citation(gen.find("D"), c);
+        assert(gen.get_parents(gen.find("D")).size() == 2);
+        assert(gen.get_children(b) == std::vector<Publication::id_type>{"C"});
+        assert(gen[c].get_id() == "C");
+        gen.remove("C");
+        assert(!gen.exists(c));
+        gen.create("E", "A");
+        assert(!gen.exists(c));
+        try {
+            gen[c];
+            assert(false);
+        } catch (PublicationNotFound &) {}
+        assert(gen.exists(gen.find("D")));
+    }
+
+    {
+        auto gen = CitationGraph<Publication>::build("A", {"B", "C", "D"},
+                {{"B", "A"}, {"C", "B"}, {"D", "C"}, {"D", "A"}, {"D", "C"}});
+        assert(gen.get_parents("D") == (std::vector<Publication::id_type>{"A", "C"}));
+        assert(gen.get_children("A").size() == 2);
+        assert(gen.memory_stats().citations == 4);
+        gen.remove("B");
+        assert(gen.exists("D") && !gen.exists("C"));
+        gen.create_batch({"E", "F"}, {{"F", "E"}, {"E", "D"}, {"D", "A"}, {"F", "A"}});
+        assert(gen.get_children("D") == std::vector<Publication::id_type>{"E"});
+        auto children = gen.get_children("A");
+        assert((std::set<Publication::id_type>(children.begin(), children.end())
+                == std::set<Publication::id_type>{"D", "F"}));
+        try {
+            gen.create_batch({"G", "H"}, {{"G", "A"}});
+            assert(false);
+        } catch (PublicationNotFound &) {}
+        try {
+            gen.create_batch({"G", "G"}, {{"G", "A"}});
+            assert(false);
+        } catch (PublicationAlreadyCreated &) {}
+        try {
+            gen.create_batch({"G"}, {{"G", "A"}, {"A", "Z"}});
+            assert(false);
+        } catch (PublicationNotFound &) {}
+        assert(!gen.exists("G") && !gen.exists("H"));
+        assert(gen.get_children("A").size() == 2);
+        assert(gen.memory_stats().live_publications == 4);
+        assert(gen.memory_stats().citations == 4);
+    }
+    {
+        bool succeeded = false;
+        gThrowCounter = 1000;
+        CitationGraph<PublicationThrowEverything> gen({1});
+        gen.create(PublicationThrowEverything::id_type{2}, PublicationThrowEverything::id_type{1});
+
+        for (long nextThrowCount = 0; !succeeded; ++nextThrowCount) {
+            try {
+                gThrowCounter = nextThrowCount;
+                gen.create_batch({{3}, {4}}, {{{3}, {1}}, {{4}, {3}}, {{4}, {2}}, {{2}, {3}}});
+                succeeded = true;
+            }
+            catch (...) {
+                assert(!gen.exists(PublicationThrowEverything::id_type{3}));
+                assert(!gen.exists(PublicationThrowEverything::id_type{4}));
+                assert(equalsVectors(gen.get_children(PublicationThrowEverything::id_type{1}), {2}));
+                assert(equalsVectors(gen.get_children(PublicationThrowEverything::id_type{2}), {}));
+                assert(equalsVectors(gen.get_parents(PublicationThrowEverything::id_type{2}), {1}));
+            }
+        }
+        gThrowCounter = 1000;
+        assert(equalsVectors(gen.get_parents(PublicationThrowEverything::id_type{2}), {1, 3}));
+        assert(equalsVectors(gen.get_children(PublicationThrowEverything::id_type{3}), {2, 4}));
+    }
+
+    {
+        std::string path = (std::filesystem::temp_directory_path() / "grafCytowan.snapshot").string();
+        CitationGraph<Publication> gen("Goto Considered Harmful");
+        gen.create("B", "Goto Considered Harmful");
+        gen.create("C", "B");
+        gen.create("D", std::vector<Publication::id_type>{"B", "C"});
+        gen.create("E", "D");
+        gen.remove("C");
+        gen.save(path);
+
+        MappedCitationGraph<Publication> mapped(path);
+        assert(mapped.size() == 4);
+        assert(mapped.citation_count() == 3);
+        assert(mapped.get_root_id() == "Goto Considered Harmful");
+        assert(mapped.get_children("B") == std::vector<Publication::id_type>{"D"});
+        assert(!mapped.exists("C"));
+
+        auto loaded = CitationGraph<Publication, HashIdIndex<> >::load(path);
+        assert(loaded.get_root_id() == "Goto Considered Harmful");
+        assert(loaded.get_parents("E") == std::vector<Publication::id_type>{"D"});
+        assert(loaded.memory_stats().citations == 3);
+        loaded.remove("B");
+        assert(!loaded.exists("E"));
+        std::filesystem::remove(path);
+
+        CitationGraph<PublicationThrowEverything> numbers({1});
+        numbers.create(PublicationThrowEverything::id_type{2}, PublicationThrowEverything::id_type{1});
+        numbers.save(path);
+        auto reloaded = CitationGraph<PublicationThrowEverything>::load(path);
+        assert(equalsVectors(reloaded.get_children({1}), {2}));
+        std::filesystem::remove(path);
+
+        // Corrupted files are refused, also when the checksum was patched
+        // up to match.
+        CitationGraph<Publication> small("A");
+        small.create("B", "A");
+        small.create("C", "A");
+        small.create("D", std::vector<Publication::id_type>{"B", "C"});
+        small.save(path);
+        std::string bytes;
+        {
+            std::ifstream in(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        citation_graph_detail::snapshot_header header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        citation_graph_detail::snapshot_sections sections(header);
+        auto rejects = [&](std::string corrupt, bool reseal) {
+            if (reseal) {
+                citation_graph_detail::snapshot_checksum checksum;
+                checksum.add(corrupt.data() + sizeof(header), corrupt.size() - sizeof(header));
+                std::uint32_t sum = checksum.value();
+                std::memcpy(&corrupt[offsetof(citation_graph_detail::snapshot_header, checksum)], &sum, sizeof(sum));
+            }
+            std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupt.data(), std::streamsize(corrupt.size()));
+            try {
+                (void) CitationGraph<Publication>::load(path);
+            } catch (InvalidSnapshot &) {
+                return true;
+            }
+            return false;
+        };
+        auto refused = [&](std::uint64_t offset, std::uint32_t value, bool reseal) {
+            std::string corrupt = bytes;
+            std::memcpy(&corrupt[offset], &value, sizeof(value));
+            return rejects(corrupt, reseal);
+        };
+        // Numbered A, B, C, D: children A: 1 2, B: 3, C: 3; parents B: 0, C: 0, D: 1 2.
+        assert(!refused(sections.children + 4, 2, true));
+        assert(refused(sections.children + 4, 1, false));
+        assert(refused(sections.children + 4, 1, true));
+        assert(refused(sections.parents + 8, 0, true));
+
+        // The root citing its own child back, and C citing itself: ordering
+        // from the root reaches the root twice, which must not make up for C.
+        CitationGraph<Publication> triangle("A");
+        triangle.create("B", "A");
+        triangle.create("C", std::vector<Publication::id_type>{"A", "B"});
+        triangle.save(path);
+        {
+            std::ifstream in(path, std::ios::binary);
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        citation_graph_detail::snapshot_sections looped(header);
+        std::string corrupt = bytes;
+        for (std::uint64_t i = 0; i < 4; ++i) {
+            std::uint64_t offset = i;
+            std::memcpy(&corrupt[looped.child_offsets + 8 * i], &offset, sizeof(offset));
+            std::memcpy(&corrupt[looped.parent_offsets + 8 * i], &offset, sizeof(offset));
+        }
+        std::uint32_t lists[] = {1, 0, 2};
+        std::memcpy(&corrupt[looped.children], lists, sizeof(lists));
+        std::memcpy(&corrupt[looped.parents], lists, sizeof(lists));
+        assert(!rejects(bytes, true) && rejects(corrupt, true));
+        std::filesystem::remove(path);
+    }
+
+    {
+        CitationGraph<Publication> gen("A");
+        CitationLoadOptions options;
+        options.threads = 3;
+        options.chunk_bytes = 8;
+        auto report = load_citations(gen,
+                "B\tA\n"
+                "C\tB\n"
+                "# comment\n"
+                "C\tA\r\n"
+                "broken line\n"
+                "D\tZ\n"
+                "E\tD\n"
+                "\n"
+                "B\tC\tA\n"
+                "F\tC\n", options);
+        assert(report.lines == 10);
+        assert(report.publications_created == 3);
+        assert(report.citations_added == 4);
+        assert(report.issues.size() == 4);
+        assert(report.issues[0].line == 5);
+        assert(report.issues[0].problem == CitationLoadReport::Problem::malformed_line);
+        assert(report.issues[1].line == 6);
+        assert(report.issues[1].problem == CitationLoadReport::Problem::unknown_parent);
+        assert(report.issues[2].line == 7);
+        assert(report.issues[3].line == 9);
+        assert(gen.get_parents("C").size() == 2);
+        assert(gen.exists("F") && !gen.exists("D") && !gen.exists("E"));
+
+        options.delimiter = ',';
+        report = load_citations(gen, "\"G\",\"F\"\nH,G\n", options);
+        assert(report.issues.empty());
+        assert(gen.get_parents("H") == std::vector<Publication::id_type>{"G"});
+    }
+
+    {
+        // A few lines that close a cycle in a large file cost only themselves.
+        CitationGraph<Publication> gen("A");
+        std::string text;
+        for (int i = 1; i <= 20000; ++i) {
+            text += "N" + std::to_string(i) + "\t" + (i == 1 ? std::string("A") : "N" + std::to_string(i - 1)) + "\n";
+            if (i == 5000)
+                text += "N5\tN100\n";
+            if (i == 10000)
+                text += "N7\tN7\nA\tN3\n";
+        }
+        CitationLoadOptions options;
+        options.threads = 4;
+        options.chunk_bytes = 4096;
+        auto report = load_citations(gen, text, options);
+        assert(report.lines == 20003);
+        assert(report.publications_created == 20000);
+        assert(report.citations_added == 20000);
+        assert(report.issues.size() == 3);
+        assert(report.issues[0].line == 5001);
+        assert(report.issues[1].line == 10002);
+        assert(report.issues[2].line == 10003);
+        for (auto const &issue : report.issues)
+            assert(issue.problem == CitationLoadReport::Problem::cycle);
+        assert(gen.get_parents("N20000") == std::vector<Publication::id_type>{"N19999"});
+        assert(gen.get_parents("N5") == std::vector<Publication::id_type>{"N4"});
+        assert(gen.get_parents("A").empty());
+    }
+
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "A");
+        gen.create("D", std::vector<Publication::id_type>{"B", "C"});
+        gen.create("E", "D");
+        assert(gen.influence("A") == 4);
+        assert(gen.influence("B") == 2);
+        assert(gen.influence("E") == 0);
+        auto all = gen.influence_all();
+        assert(all.size() == 5 && all.front() == std::make_pair(Publication::id_type("A"), std::size_t(4)));
+        for (auto const &estimate : gen.estimate_influence_all())
+            assert(estimate.second == double(gen.influence(estimate.first)));
+
+        gen.track_influence(true);
+        assert(gen.influence("C") == 2);
+        gen.create("F", "E");
+        assert(gen.influence("C") == 3);
+        assert(gen.influence("A") == 5);
+        gen.add_citation("F", "B");
+        gen.remove("C");
+        assert(gen.influence("A") == 4);
+        assert(gen.influence("B") == 3);
+        gen.create("G", "A");
+        gen.add_citation("E", "G");
+        {
+            auto transaction = gen.begin_transaction();
+            gen.remove("G");
+        }
+        assert(gen.influence("G") == 2);
+        // B keeps F, which cites it directly, but reached E only through D.
+        gen.remove("D");
+        assert(gen.influence("B") == 1);
+        assert(gen.influence("A") == 4);
+        auto recount = gen.clone();
+        recount.track_influence(false);
+        assert(gen.influence_all() == recount.influence_all());
+
+        // Creating at the end of a chain longer than the walk budget leaves
+        // the counts to be recomputed, which must still come out right.
+        CitationGraph<Publication> chain("0");
+        chain.track_influence(true);
+        assert(chain.influence("0") == 0);
+        for (int i = 1; i <= 6000; ++i)
+            chain.create(std::to_string(i), std::to_string(i - 1));
+        assert(chain.influence("0") == 6000 && chain.influence("5990") == 10);
+        chain.create("leaf", "6000");
+        assert(chain.influence("0") == 6001 && chain.influence("6000") == 1);
+
+        std::size_t const width = 3000;
+        CitationGraph<Publication> wide("root");
+        for (std::size_t i = 0; i < width; ++i)
+            wide.create(std::to_string(i), i < 10 ? "root" : std::to_string(i / 10));
+        auto exact = wide.influence_all();
+        auto estimated = wide.estimate_influence_all(256);
+        assert(exact.size() == width + 1 && estimated.size() == width + 1);
+        for (std::size_t i = 0; i < exact.size(); ++i) {
+            assert(exact[i].second == wide.influence(exact[i].first));
+            assert(std::abs(estimated[i].second - double(exact[i].second)) <= 0.25 * double(exact[i].second));
+        }
+    }
+    {
+        using id_type = Publication::id_type;
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "A");
+        gen.create("D", "B");
+        auto before = [&gen](id_type const &a, id_type const &b) {
+            auto order = gen.topological_order();
+            return std::find(order.begin(), order.end(), a) < std::find(order.begin(), order.end(), b);
+        };
+        assert(gen.topological_order().size() == 4 && before("A", "D"));
+
+        gen.add_citation("B", "C");
+        assert(before("C", "B") && before("B", "D"));
+        gen.add_citation("D", "C");
+        for (auto const &citation : std::vector<std::pair<id_type, id_type> >{{"C", "D"}, {"C", "C"}, {"A", "D"}}) {
+            try {
+                gen.add_citation(citation.first, citation.second);
+                assert(false);
+            } catch (CitationCycle &) {
+            }
+        }
+        gen.create("E", "D");
+        try {
+            gen.add_citation("D", "E");
+            assert(false);
+        } catch (CitationCycle &) {
+        }
+        assert(gen.get_parents("D") == (std::vector<id_type>{"B", "C"}));
+        assert(gen.get_children("E").empty());
+
+        try {
+            gen.create_batch({"X", "Y"}, {{"X", "E"}, {"Y", "X"}, {"X", "Y"}});
+            assert(false);
+        } catch (CitationCycle &) {
+        }
+        try {
+            gen.create_batch({"X"}, {{"X", "E"}, {"B", "X"}});
+            assert(false);
+        } catch (CitationCycle &) {
+        }
+        assert(!gen.exists("X") && gen.get_parents("B") == (std::vector<id_type>{"A", "C"}));
+
+        gen.create_batch({"X"}, {{"X", "A"}, {"C", "X"}});
+        assert(before("X", "C") && before("C", "B") && before("D", "E"));
+        gen.remove("C");
+        assert(gen.topological_order() == (std::vector<id_type>{"A", "X", "B", "D", "E"}));
+    }
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "A");
+        gen.create("D", "B");
+        for (std::size_t labels : {0, 1, 3}) {
+            gen.index_reachability(labels);
+            assert(gen.is_descendant("A", "D") && gen.is_descendant("B", "D"));
+            assert(!gen.is_descendant("C", "D") && !gen.is_descendant("D", "A") && !gen.is_descendant("A", "A"));
+        }
+        gen.create("E", std::vector<Publication::id_type>{"C", "D"});
+        assert(gen.is_descendant("C", "E") && gen.is_descendant("B", "E"));
+        gen.add_citation("C", "B");
+        assert(gen.is_descendant("B", "C"));
+        gen.remove("B");
+        assert(!gen.exists("D") && gen.is_descendant("A", "E") && gen.is_descendant("C", "E"));
+        try {
+            gen.is_descendant("A", "B");
+            assert(false);
+        } catch (PublicationNotFound &) {
+        }
+    }
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "A");
+        gen.create("D", std::vector<Publication::id_type>{"B", "C"});
+        gen.create("E", "B");
+        auto csr = gen.compress();
+        assert(csr.ids.front() == "A" && csr.ids.size() == 5);
+        assert(csr.children.size() == 5 && csr.parent_offsets.back() == 5);
+
+        PageRankOptions options;
+        options.tolerance = 1e-7;
+        options.threads = 1;
+        PageRankResult single = page_rank(csr, options);
+        options.threads = 3;
+        options.parallel_threshold = 0;
+        PageRankResult parallel = page_rank(csr, options);
+        assert(single.converged && single.residuals.size() == single.iterations);
+        double total = 0;
+        for (std::size_t i = 0; i < csr.ids.size(); ++i) {
+            total += single.scores[i];
+            assert(std::abs(single.scores[i] - parallel.scores[i]) < 1e-6);
+        }
+        assert(std::abs(total - 1) < 1e-4);
+        auto scoreOf = [&](std::string const &id) {
+            return single.scores[std::find(csr.ids.begin(), csr.ids.end(), id) - csr.ids.begin()];
+        };
+        assert(scoreOf("A") > scoreOf("B") && scoreOf("B") > scoreOf("C") && scoreOf("C") > scoreOf("D"));
+        assert(std::abs(scoreOf("D") - scoreOf("E")) < 1e-6);
+    }
+    {
+        ConcurrentCitationGraph<Publication> shared("A");
+        auto before = shared.snapshot();
+        shared.create("B", "A");
+        shared.update([](CitationGraph<Publication> &gen) {
+            gen.create("C", "B");
+            gen.create("D", "B");
+        });
+        auto after = shared.snapshot();
+        assert(before.number() == 0 && after.number() == 2);
+        assert(!before.exists("B") && before.get_children("A").empty());
+        assert(after.get_children("B") == (std::vector<Publication::id_type>{"C", "D"}));
+        shared.add_citation("C", "B");
+        assert(shared.snapshot().number() == 2);
+
+        try {
+            shared.update([](CitationGraph<Publication> &gen) {
+                gen.create("E", "D");
+                gen.create("F", "missing");
+            });
+            assert(false);
+        } catch (PublicationNotFound &) {
+        }
+        shared.remove("C");
+        auto last = shared.snapshot();
+        assert(last.number() == 3 && !last.exists("E") && !last.exists("C"));
+        assert(after.exists("C") && after.get_parents("C") == std::vector<Publication::id_type>{"B"});
+
+        std::vector<std::thread> readers;
+        std::atomic<bool> done {false};
+        for (int reader = 0; reader < 2; ++reader) {
+            readers.emplace_back([&shared, &done]() {
+                while (!done) {
+                    auto view = shared.snapshot();
+                    for (auto const &id : view.topological_order()) {
+                        for (auto const &parent : view.parents_view(id))
+                            assert(view.exists(parent));
+                    }
+                }
+            });
+        }
+        for (int i = 0; i < 50; ++i)
+            shared.create("G" + std::to_string(i), i % 2 ? "B" : "D");
+        shared.remove("D");
+        done = true;
+        for (auto &reader : readers)
+            reader.join();
+        assert(shared.snapshot().number() == 54);
+    }
+    {
+        ShardedCitationGraph<Publication> ingest("root", 8);
+        std::vector<std::thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&ingest, writer]() {
+                std::string previous = "root";
+                for (int i = 0; i < 200; ++i) {
+                    std::string id = std::to_string(writer) + "-" + std::to_string(i);
+                    ingest.create(id, previous);
+                    if (i > 0)
+                        ingest.add_citation(id, "root");
+                    previous = id;
+                }
+            });
+        }
+        for (auto &writer : writers)
+            writer.join();
+        assert(ingest.size() == 801);
+        auto parents = ingest.get_parents("2-5");
+        assert(std::set<Publication::id_type>(parents.begin(), parents.end())
+               == (std::set<Publication::id_type>{"2-4", "root"}));
+        assert(ingest.get_children("root").size() == 800);
+        try {
+            ingest.create("2-5", "root");
+            assert(false);
+        } catch (PublicationAlreadyCreated &) {
+        }
+        try {
+            ingest.create("X", std::vector<Publication::id_type>{"root", "missing"});
+            assert(false);
+        } catch (PublicationNotFound &) {
+        }
+        assert(!ingest.exists("X"));
+
+        ingest.add_citation("2-5", "root");
+        ingest.add_citation("2-5", "2-4");
+        assert(ingest.get_parents("2-5").size() == 2 && ingest.get_children("2-4").size() == 1);
+        assert(ingest.get_children("root").size() == 800);
+
+        auto gen = ingest.build();
+        assert(gen.memory_stats().live_publications == 801 && gen.memory_stats().citations == 800 + 4 * 199);
+        assert(gen.get_children("3-198") == std::vector<Publication::id_type>{"3-199"});
+
+        ingest.add_citation("0-0", "1-199");
+        ingest.add_citation("1-0", "0-199");
+        try {
+            ingest.build();
+            assert(false);
+        } catch (CitationCycle &) {
+        }
+    }
+    {
+        CitationGraph<Publication, OrderedIdIndex, CountingCitationStats> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "B");
+        gen.create("D", std::vector<Publication::id_type>{"B", "C"});
+        gen.add_citation("D", "A");
+        std::uint64_t lookups = gen.stats().lookups;
+        assert(lookups > 0);
+        assert(gen.exists("C") && !gen.exists("E"));
+        auto handle = gen.find("D");
+        assert(gen.stats().lookups == lookups + 3);
+        assert(gen.get_parents(handle).size() == 3);
+        assert(gen.stats().lookups == lookups + 3);
+        gen.remove("B");
+        CitationGraphStats stats = gen.stats();
+        assert(stats.lookups > lookups + 3);
+        assert(stats.edge_inserts == 5 && stats.edge_erases == 4);
+        assert(stats.removals == 1 && stats.removed_publications == 2);
+        assert(stats.cascade_lengths[1] == 1 && stats.cascade_lengths[0] == 0);
+        assert(stats.live_publications == 2 && stats.free_slots == 2);
+        assert(stats.allocations > 0);
+
+        CitationGraph<Publication> plain("A");
+        plain.create("B", "A");
+        assert(plain.stats().lookups == 0 && plain.stats().live_publications == 2);
+
+        CitationGraphStats copied = gen.clone().stats();
+        assert(copied.lookups == gen.stats().lookups && copied.edge_inserts == 5 && copied.removals == 1);
+
+        ConcurrentCitationGraph<Publication, OrderedIdIndex, CountingCitationStats> shared(std::move(gen));
+        shared.create("E", "D");
+        shared.update([](CitationGraph<Publication, OrderedIdIndex, CountingCitationStats> &next) {
+            next.create("F", "E");
+            next.add_citation("F", "A");
+        });
+        shared.remove("E");
+        CitationGraphStats published = shared.snapshot().stats();
+        assert(published.edge_inserts == 5 + 3 && published.removals == 2 && published.removed_publications == 3);
+        assert(published.lookups > copied.lookups && published.live_publications == 3);
+    }
+    {
+        class CountingResource : public std::pmr::memory_resource {
+        public:
+            std::size_t live = 0;
+            std::size_t total = 0;
+
+        private:
+            void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+                void *p = std::pmr::new_delete_resource() -> allocate(bytes, alignment);
+                live += bytes;
+                total += bytes;
+                return p;
+            }
+            void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override {
+                live -= bytes;
+                std::pmr::new_delete_resource() -> deallocate(p, bytes, alignment);
+            }
+            bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+                return this == &other;
+            }
+        };
+
+        CountingResource counting;
+        std::pmr::monotonic_buffer_resource arena;
+        {
+            CitationGraph<Publication, HashIdIndex<> > gen("A", &counting);
+            assert(gen.resource() == &counting && counting.total > 0);
+            std::size_t before = counting.total;
+            for (int i = 0; i < 1000; ++i)
+                gen.create(std::to_string(i), i == 0 ? "A" : std::to_string(i / 2));
+            assert(counting.total > before);
+            gen.remove("1");
+
+            CitationGraph<Publication, HashIdIndex<> > other("B", &arena);
+            other.create("C", "B");
+            std::swap(gen, other);
+            assert(gen.resource() == &arena && other.resource() == &counting);
+            assert(gen.get_children("B") == std::vector<Publication::id_type>{"C"});
+            assert(other.exists("0") && !other.exists("1"));
+
+            auto copy = other.clone(&arena);
+            assert(copy.resource() == &arena && copy.get_parents("0") == std::vector<Publication::id_type>{"A"});
+        }
+        assert(counting.live == 0);
+    }
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "B");
+        gen.track_influence(true);
+        assert(gen.influence("A") == 2);
+        {
+            auto transaction = gen.begin_transaction();
+            gen.create("D", "C");
+            gen.create_batch({"E", "F"}, {{"E", "D"}, {"F", "E"}, {"F", "A"}});
+            gen.add_citation("B", "D");
+            gen.remove("F");
+            assert(!gen.exists("F") && gen.exists("E") && gen.is_descendant("D", "C"));
+            assert(gen.get_children("A") == std::vector<Publication::id_type>{"B"});
+            bool thrown = false;
+            try {
+                (void) gen.begin_transaction();
+            } catch (TransactionInProgress &) {
+                thrown = true;
+            }
+            assert(thrown);
+            thrown = false;
+            try {
+                transaction.commit();
+            } catch (CitationCycle &) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+        assert(gen.get_children("B") == std::vector<Publication::id_type>{"C"});
+        assert(gen.get_parents("B") == std::vector<Publication::id_type>{"A"});
+        assert(!gen.exists("D") && !gen.exists("E") && !gen.exists("F"));
+        assert(gen.memory_stats().live_publications == 3 && gen.memory_stats().citations == 2);
+        assert(gen.influence("A") == 2 && gen.topological_order().size() == 3);
+
+        {
+            auto transaction = gen.begin_transaction();
+            gen.create("D", "A");
+            gen.add_citation("D", "C");
+            gen.remove("B");
+            assert(gen.is_descendant("A", "D") && !gen.exists("C"));
+            bool thrown = false;
+            try {
+                gen.create("C", "A");
+            } catch (PublicationAlreadyCreated &) {
+                thrown = true;
+            }
+            assert(thrown);
+            transaction.rollback();
+        }
+        assert(gen.exists("C") && !gen.exists("D") && gen.memory_stats().citations == 2);
+
+        auto transaction = gen.begin_transaction();
+        gen.create("D", "C");
+        gen.add_citation("B", "A");
+        gen.remove("B");
+        gen.create("E", "A");
+        transaction.commit();
+        assert(!gen.exists("B") && !gen.exists("C") && !gen.exists("D") && gen.exists("E"));
+        assert(gen.topological_order() == std::vector<Publication::id_type>({"A", "E"}));
+        assert(gen.memory_stats().live_publications == 2 && gen.memory_stats().citations == 1);
+        assert(gen.influence("A") == 1);
+        gen.create("B", "E");
+        assert(gen.is_descendant("A", "B"));
+    }
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", std::vector<Publication::id_type>{"A", "B"});
+        auto a = gen.key_of("A");
+        auto c = gen.key_of(gen.find("C"));
+        assert(gen.id_of(c) == "C" && gen.publication_at(a).get_id() == "A");
+        assert(gen.child_keys(a).size() == 2 && gen.parent_keys(c).size() == 2);
+
+        // Publications within two citations of A, on keys only.
+        std::vector<bool> seen(gen.key_bound());
+        std::vector<CitationGraph<Publication>::key_type> frontier {a};
+        std::size_t reached = 0;
+        for (int depth = 0; depth < 2; ++depth) {
+            std::vector<CitationGraph<Publication>::key_type> next;
+            for (auto key : frontier) {
+                for (auto child : gen.child_keys(key)) {
+                    if (!seen[child]) {
+                        seen[child] = true;
+                        next.push_back(child);
+                        ++reached;
+                    }
+                }
+            }
+            frontier.swap(next);
+        }
+        assert(reached == 2);
+
+        auto b = gen.key_of("B");
+        auto handle = gen.handle_at(b);
+        gen.remove("B");
+        assert(!gen.contains_key(b) && !gen.exists(handle) && gen.contains_key(c));
+        bool thrown = false;
+        try {
+            gen.id_of(b);
+        } catch (PublicationNotFound &) {
+            thrown = true;
+        }
+        assert(thrown);
+        gen.create("D", "A");
+        assert(gen.key_of("D") == b && gen.handle_at(b) != handle);
+    }
+    {
+        CitationGraph<Publication> gen("A");
+        gen.create("B", "A");
+        gen.create("C", "A");
+        gen.create("D", "B");
+        gen.create("E", std::vector<Publication::id_type>{"C", "D"});
+        gen.create("F", "E");
+        assert(descendants(gen, {"A"}, 1) == std::vector<Publication::id_type>({"B", "C"}));
+        assert(descendants(gen, {"B", "C"}, 2).size() == 3);
+        assert(descendants(gen, {"A"}, 0).empty());
+        assert(ancestors(gen, {"E"}, 10).size() == 4);
+        assert(ancestors(gen, {"F", "D"}, 1) == std::vector<Publication::id_type>({"B", "E"}));
+        auto cone = descendants(gen, {"A", "B"}, 2);
+        assert(std::set<Publication::id_type>(cone.begin(), cone.end())
+               == (std::set<Publication::id_type>{"C", "D", "E"}) && cone.size() == 3);
+        cone = ancestors(gen, {"F", "E"}, 1);
+        assert(std::set<Publication::id_type>(cone.begin(), cone.end())
+               == (std::set<Publication::id_type>{"C", "D"}) && cone.size() == 2);
+
+        std::vector<std::size_t> depths;
+        for_each_descendant(gen, {"A"}, 10, [&](auto key, std::size_t depth) {
+            assert(gen.contains_key(key));
+            depths.push_back(depth);
+        });
+        assert(depths == std::vector<std::size_t>({1, 1, 2, 2, 3}));
+
+        // Many threads, both directions: the same cones.
+        for (int i = 0; i < 2000; ++i)
+            gen.create("G" + std::to_string(i), std::vector<Publication::id_type>{
+                    i < 2 ? "F" : "G" + std::to_string(i / 2), i < 3 ? "A" : "G" + std::to_string(i / 3)});
+        TraversalOptions eager;
+        eager.threads = 4;
+        eager.parallel_threshold = 0;
+        eager.alpha = 1e9;
+        TraversalOptions plain;
+        plain.threads = 1;
+        plain.alpha = 0;
+        for (std::size_t depth : {1, 3, 30}) {
+            assert(descendants(gen, {"A"}, depth, eager) == descendants(gen, {"A"}, depth, plain));
+            assert(descendants(gen, {"G5", "G7"}, depth, eager) == descendants(gen, {"G5", "G7"}, depth, plain));
+            assert(ancestors(gen, {"G1999"}, depth, eager) == ancestors(gen, {"G1999"}, depth, plain));
+        }
+        assert(descendants(gen, {"A"}, 100, eager).size() == gen.influence("A"));
+        bool thrown = false;
+        try {
+            descendants(gen, {"Z"}, 1);
+        } catch (PublicationNotFound &) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    {
+        CitationGraph<Publication> gen("A");
+        gen.defer_reclamation(true, 2);
+        gen.create("B", "A");
+        for (int i = 0; i < 10; ++i)
+            gen.create("C" + std::to_string(i), "B");
+        gen.create("D", std::vector<Publication::id_type>{"A", "C0"});
+        gen.remove("B");
+        assert(!gen.exists("B") && !gen.exists("C3") && gen.exists("D"));
+        assert(gen.get_parents("D") == std::vector<Publication::id_type>{"A"});
+        assert(gen.memory_stats().live_publications == 2 && gen.memory_stats().retired_publications == 11);
+        assert(gen.topological_order() == std::vector<Publication::id_type>({"A", "D"}));
+
+        gen.create("C5", "D");
+        assert(gen.memory_stats().retired_publications == 8);
+        gen.add_citation("C5", "A");
+        assert(gen.memory_stats().retired_publications == 6);
+        assert(gen.drain() == 6 && gen.memory_stats().retired_publications == 0);
+        assert(gen.memory_stats().free_slots == 10 && gen.memory_stats().dead_index_entries == 0);
+
+        {
+            auto transaction = gen.begin_transaction();
+            gen.remove("D");
+            transaction.commit();
+        }
+        assert(gen.memory_stats().retired_publications == 1 && gen.exists("C5"));
+        gen.defer_reclamation(false);
+        assert(gen.memory_stats().retired_publications == 0 && gen.memory_stats().live_publications == 2);
+        gen.create("D", "A");
+        gen.remove("D");
+        assert(gen.memory_stats().free_slots == 11);
+    }
+    {
+        auto buffer = std::make_unique<CitationLogBuffer>();
+        CitationLogBuffer *sink = buffer.get();
+        CitationLogOptions options;
+        options.group_records = 3;
+        LoggedCitationGraph<Publication> primary(CitationGraph<Publication>("A"), std::move(buffer), options);
+        primary.create("B", "A");
+        primary.create("C", std::vector<Publication::id_type>{"A", "B"});
+        assert(sink -> bytes.empty());
+        bool thrown = false;
+        try {
+            primary.create("B", "A");
+        } catch (PublicationAlreadyCreated &) {
+            thrown = true;
+        }
+        assert(thrown);
+        primary.create("D", "C");
+        primary.add_citation("D", "B");
+        assert(!sink -> bytes.empty());
+        primary.remove("B");
+        primary.create("B", "D");
+        primary.flush();
+
+        CitationGraph<Publication> replica("A");
+        std::string log = sink -> bytes;
+        CitationReplay first = replay(replica, std::string_view(log).substr(0, log.size() - 3));
+        assert(first.records == 5 && first.bytes < log.size());
+        assert(!replica.exists("B") && replica.exists("D"));
+        CitationReplay rest = replay(replica, std::string_view(log).substr(first.bytes));
+        assert(rest.records == 1 && first.bytes + rest.bytes == log.size());
+        assert(replica.get_parents("D") == primary.graph().get_parents("D"));
+        assert(replica.get_children("D") == std::vector<Publication::id_type>{"B"});
+        assert(replica.memory_stats().citations == primary.graph().memory_stats().citations);
+
+        log[10] ^= 1;
+        CitationGraph<Publication> damaged("A");
+        thrown = false;
+        try {
+            replay(damaged, log);
+        } catch (InvalidMutationLog &) {
+            thrown = true;
+        }
+        assert(thrown && !damaged.exists("B"));
+
+        std::string path = (std::filesystem::temp_directory_path() / "grafCytowan.log").string();
+        std::filesystem::remove(path);
+        {
+            options.sync = CitationLogOptions::Sync::periodic;
+            LoggedCitationGraph<Publication> writer(CitationGraph<Publication>("A"),
+                                                    std::make_unique<CitationLogFile>(path), options);
+            CitationGraph<Publication> follower("A");
+            CitationLogTail tail(path);
+            writer.create("B", "A");
+            writer.create("C", "B");
+            writer.flush();
+            assert(tail.follow(follower).records == 2 && follower.exists("C"));
+            writer.remove("B");
+            assert(tail.follow(follower).records == 0);
+            writer.flush();
+            assert(tail.follow(follower).records == 1 && !follower.exists("C"));
+            assert(tail.offset() == std::filesystem::file_size(path));
+
+            // Past 4 GiB nothing is there yet; past what the platform can
+            // seek to is an error, not a wrapped-around offset.
+            CitationLogTail far(path, std::uint64_t(5) << 30);
+            assert(far.follow(follower).records == 0 && far.offset() == std::uint64_t(5) << 30);
+            CitationLogTail beyond(path, ~std::uint64_t(0));
+            thrown = false;
+            try {
+                beyond.follow(follower);
+            } catch (std::system_error &) {
+                thrown = true;
+            }
+            assert(thrown);
+        }
+        std::filesystem::remove(path);
+
+        class CountingSink : public CitationLogSink {
+        public:
+            void write(char const *, std::size_t size) override {
+                written += size;
+            }
+            void sync() override {
+                ++syncs;
+            }
+
+            std::size_t written = 0;
+            std::size_t syncs = 0;
+        };
+        auto counting = std::make_unique<CountingSink>();
+        CountingSink *idle = counting.get();
+        options.group_delay = std::chrono::milliseconds(0);
+        options.sync_interval = std::chrono::milliseconds(30);
+        LoggedCitationGraph<Publication> quiet(CitationGraph<Publication>("A"), std::move(counting), options);
+        quiet.create("B", "A");
+        assert(idle -> written == 0);
+        quiet.flush_if_due();
+        assert(idle -> written != 0);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        quiet.flush_if_due();
+        assert(idle -> syncs == 1);
+        quiet.flush_if_due();
+        assert(idle -> syncs == 1);
+    }
+    {
+        class Paper {
+        public:
+            typedef std::uint32_t id_type;
+            Paper(id_type const &id) : id(id) {
+            }
+            id_type get_id() const noexcept {
+                return id;
+            }
+        private:
+            id_type id;
+        };
+
+        static_assert(std::is_same<CitationGraph<Paper>, CitationGraph<Paper, DenseIdIndex> >::value,
+                      "integral ids get the dense index by default");
+        static_assert(std::is_same<CitationGraph<Publication>, CitationGraph<Publication, OrderedIdIndex> >::value,
+                      "other ids keep the ordered index");
+        CitationGraph<Paper> gen(0);
+        for (Paper::id_type id = 1; id < 1000; ++id)
+            gen.create(id, std::vector<Paper::id_type>{id / 2, id / 3});
+        assert(gen.exists(999u) && !gen.exists(1000u) && gen[500u].get_id() == 500);
+        assert(gen.get_parents(12u) == std::vector<Paper::id_type>({4, 6}));
+
+        // Far beyond the dense range: kept aside, found all the same.
+        gen.create(4000000000u, 7u);
+        gen.create(3000000u, std::vector<Paper::id_type>{4000000000u, 1u});
+        assert(gen.exists(4000000000u) && gen.get_children(4000000000u) == std::vector<Paper::id_type>{3000000u});
+        gen.remove(7u);
+        assert(!gen.exists(4000000000u) && !gen.exists(7u) && gen.exists(14u));
+        assert(gen.get_parents(3000000u) == std::vector<Paper::id_type>{1});
+        assert(gen.memory_stats().dead_index_entries == 0);
+        gen.create(7u, 0u);
+        assert(gen.get_parents(7u) == std::vector<Paper::id_type>{0});
+
+        // Spilled while the dense range was small, still found once it has
+        // grown past it.
+        CitationGraph<Paper> late(0);
+        late.create(200u, 0u);
+        for (Paper::id_type id = 1; id < 150; ++id)
+            late.create(id, 0u);
+        assert(late.exists(200u) && late.get_parents(200u) == std::vector<Paper::id_type>{0});
+
+        std::string path = (std::filesystem::temp_directory_path() / "grafCytowan.dense.snapshot").string();
+        gen.save(path);
+        auto loaded = CitationGraph<Paper>::load(path);
+        std::filesystem::remove(path);
+        assert(loaded.memory_stats().live_publications == gen.memory_stats().live_publications);
+        assert(loaded.get_children(3u) == gen.get_children(3u));
+    }
+    {
+        CitationGraph<Publication> ranked("A");
+        ranked.create("B", "A");
+        ranked.create("C", "A");
+        ranked.create("D", "A");
+        ranked.create("E", std::vector<Publication::id_type>{"B", "C"});
+        ranked.create("F", "B");
+        assert(ranked.citation_count("A") == 3 && ranked.reference_count("A") == 0);
+        assert(ranked.citation_count("E") == 0 && ranked.reference_count("E") == 2);
+        using Ranking = std::vector<std::pair<Publication::id_type, std::size_t> >;
+        assert((ranked.top_cited(2) == Ranking{{"A", 3}, {"B", 2}}));
+
+        // Counts listed must match citation_count() and never increase.
+        auto consistent = [](CitationGraph<Publication> const &graph) {
+            Ranking all = graph.top_cited(1000);
+            for (std::size_t i = 0; i < all.size(); ++i) {
+                if (graph.citation_count(all[i].first) != all[i].second)
+                    return false;
+                if (i > 0 && all[i - 1].second < all[i].second)
+                    return false;
+            }
+            return all.size() == graph.memory_stats().live_publications;
+        };
+        ranked.track_citations(true);
+        assert((ranked.top_cited(2) == Ranking{{"A", 3}, {"B", 2}}));
+        ranked.add_citation("D", "C");
+        ranked.add_citation("F", "C");
+        assert(ranked.top_cited(2).back().second == 3);
+        assert((ranked.top_cited(3).back() == std::make_pair(Publication::id_type("B"), std::size_t(2))));
+        ranked.create("G", std::vector<Publication::id_type>{"F", "E", "D"});
+        assert(consistent(ranked));
+
+        // Only A kept B alive; F still has C.
+        ranked.remove("B");
+        assert(ranked.citation_count("C") == 3 && ranked.citation_count("A") == 2 && consistent(ranked));
+        {
+            auto transaction = ranked.begin_transaction();
+            ranked.remove("C");
+            assert(!ranked.exists("E") && ranked.exists("D") && consistent(ranked));
+            assert(ranked.top_cited(1).front().second == 1 && ranked.citation_count("A") == 1);
+        }
+        assert(ranked.citation_count("C") == 3 && consistent(ranked));
+
+        ranked.defer_reclamation(true);
+        ranked.remove("D");
+        assert(ranked.citation_count("C") == 2 && consistent(ranked));
+        ranked.create_batch({"H", "I"}, {{"H", "A"}, {"I", "H"}, {"I", "C"}, {"G", "H"}});
+        assert(ranked.citation_count("H") == 2 && consistent(ranked));
+        ranked.drain();
+        CitationGraph<Publication> copy = ranked.clone();
+        assert(consistent(copy) && copy.top_cited(1) == ranked.top_cited(1));
+        ranked.track_citations(false);
+        assert(consistent(ranked) && ranked.top_cited(0).empty());
+    }
 }
\ No newline at end of file
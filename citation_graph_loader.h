@@ -0,0 +1,328 @@
+#ifndef CITATION_GRAPH_LOADER_H
+#define CITATION_GRAPH_LOADER_H
+
+#include "citation_graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// How publication ids are parsed from text. std::string takes the field as is
+// and integral ids are read in decimal; specialize this for any other id type.
+// parse() returns nothing for a field that is not a valid id.
+template <class Id, class Enable = void>
+struct CitationIdParser;
+
+template <>
+struct CitationIdParser<std::string> {
+    static std::optional<std::string> parse(std::string_view field) {
+        return std::string(field);
+    }
+};
+
+template <class Id>
+struct CitationIdParser<Id, std::enable_if_t<std::is_integral<Id>::value> > {
+    static std::optional<Id> parse(std::string_view field) {
+        Id id;
+        auto result = std::from_chars(field.data(), field.data() + field.size(), id);
+        if (result.ec != std::errc() || result.ptr != field.data() + field.size())
+            return std::nullopt;
+        return id;
+    }
+};
+
+struct CitationLoadOptions {
+    // '\t' for TSV, ',' for CSV. Fields may be wrapped in double quotes but
+    // may not contain escaped ones.
+    char delimiter = '\t';
+    // 0 means std::thread::hardware_concurrency().
+    unsigned threads = 0;
+    std::size_t chunk_bytes = std::size_t(8) << 20;
+};
+
+struct CitationLoadReport {
+    enum class Problem {
+        // Not two non-empty fields, or a field the id parser rejected.
+        malformed_line,
+        // The cited publication neither exists nor is created by this load,
+        // so the line was skipped. A new publication none of whose
+        // citations resolve is not created.
+        unknown_parent,
+        // The citation would close a cycle, with the graph or with lines
+        // applied before it, so the line was skipped.
+        cycle
+    };
+
+    struct Issue {
+        std::size_t line;
+        Problem problem;
+    };
+
+    std::size_t lines = 0;
+    std::size_t publications_created = 0;
+    std::size_t citations_added = 0;
+    std::vector<Issue> issues;
+};
+
+namespace citation_graph_detail {
+
+// What one worker makes of one chunk: the distinct ids it saw, interned to
+// chunk-local numbers, and its citations in those numbers.
+template <class Id>
+struct parsed_chunk {
+    std::vector<Id> ids;
+    std::vector<std::pair<std::uint32_t, std::uint32_t> > citations;
+    std::vector<std::size_t> citationLines;
+    std::vector<std::size_t> malformedLines;
+    std::size_t lines = 0;
+};
+
+inline std::string_view trim_field(std::string_view field) noexcept {
+    while (!field.empty() && (field.back() == '\r' || field.back() == ' '))
+        field.remove_suffix(1);
+    while (!field.empty() && field.front() == ' ')
+        field.remove_prefix(1);
+    if (field.size() >= 2 && field.front() == '"' && field.back() == '"')
+        field = field.substr(1, field.size() - 2);
+    return field;
+}
+
+// Splits text into pieces of roughly chunkBytes that end on line boundaries.
+inline std::vector<std::string_view> split_lines(std::string_view text, std::size_t chunkBytes) {
+    std::vector<std::string_view> chunks;
+    chunkBytes = std::max<std::size_t>(chunkBytes, 1);
+    while (!text.empty()) {
+        std::size_t end = std::min(chunkBytes, text.size());
+        if (end < text.size()) {
+            std::size_t newline = text.find('\n', end - 1);
+            end = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        chunks.push_back(text.substr(0, end));
+        text.remove_prefix(end);
+    }
+    return chunks;
+}
+
+// Line numbers in the result are relative to the chunk and start at 0.
+template <class Id>
+parsed_chunk<Id> parse_chunk(std::string_view text, char delimiter) {
+    parsed_chunk<Id> result;
+    std::unordered_map<std::string_view, std::uint32_t> interned;
+    auto intern = [&](std::string_view field) -> std::optional<std::uint32_t> {
+        auto found = interned.find(field);
+        if (found != interned.end())
+            return found -> second;
+        std::optional<Id> id = CitationIdParser<Id>::parse(field);
+        if (!id)
+            return std::nullopt;
+        result.ids.push_back(std::move(*id));
+        std::uint32_t local = std::uint32_t(result.ids.size() - 1);
+        interned.emplace(field, local);
+        return local;
+    };
+    while (!text.empty()) {
+        std::size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text.remove_prefix(newline == std::string_view::npos ? text.size() : newline + 1);
+        std::size_t number = result.lines++;
+
+        std::string_view stripped = trim_field(line);
+        if (stripped.empty() || stripped.front() == '#')
+            continue;
+        std::size_t split = line.find(delimiter);
+        if (split == std::string_view::npos || line.find(delimiter, split + 1) != std::string_view::npos) {
+            result.malformedLines.push_back(number);
+            continue;
+        }
+        std::string_view child = trim_field(line.substr(0, split));
+        std::string_view parent = trim_field(line.substr(split + 1));
+        std::optional<std::uint32_t> childId;
+        std::optional<std::uint32_t> parentId;
+        if (!child.empty() && !parent.empty()) {
+            childId = intern(child);
+            parentId = intern(parent);
+        }
+        if (!childId || !parentId) {
+            result.malformedLines.push_back(number);
+            continue;
+        }
+        result.citations.emplace_back(*childId, *parentId);
+        result.citationLines.push_back(number);
+    }
+    return result;
+}
+
+} // namespace citation_graph_detail
+
+// Loads "citing<delimiter>cited" lines into graph. The text is cut into
+// chunks that are parsed and interned on several threads; the results are
+// then merged in file order, so the outcome does not depend on scheduling.
+// A citing publication that does not exist yet is created, provided one of
+// its citations resolves. Bad lines are reported rather than fatal. The load
+// is applied with create_batch, so on exception nothing changes, unless some
+// lines close a cycle: then the new publications are created first and the
+// other citations added one by one in file order, skipping those lines, and
+// an exception leaves the lines before it applied.
+template <class Publication, class... Policies>
+CitationLoadReport load_citations(CitationGraph<Publication, Policies...> &graph, std::string_view text,
+                                  CitationLoadOptions const &options = CitationLoadOptions()) {
+    using id_type = typename Publication::id_type;
+    using chunk = citation_graph_detail::parsed_chunk<id_type>;
+
+    std::vector<std::string_view> pieces = citation_graph_detail::split_lines(text, options.chunk_bytes);
+    std::vector<chunk> parsed(pieces.size());
+    unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = unsigned(std::min<std::size_t>(threads, pieces.size()));
+
+    std::atomic<std::size_t> next {0};
+    std::vector<std::exception_ptr> failures(threads);
+    auto work = [&](unsigned worker) {
+        try {
+            for (std::size_t i; (i = next++) < pieces.size();)
+                parsed[i] = citation_graph_detail::parse_chunk<id_type>(pieces[i], options.delimiter);
+        } catch (...) {
+            failures[worker] = std::current_exception();
+            next = pieces.size();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (unsigned worker = 1; worker < threads; ++worker) {
+        try {
+            workers.emplace_back(work, worker);
+        } catch (std::system_error &) {
+            break;
+        }
+    }
+    if (threads > 0)
+        work(0);
+    for (auto &worker : workers)
+        worker.join();
+    for (auto const &failure : failures) {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    // Merge in chunk order. Each distinct id gets a global number the first
+    // time it is seen; existing publications are looked up once per id.
+    CitationLoadReport report;
+    std::map<id_type, std::uint32_t> global;
+    std::vector<id_type const *> idOf;
+    std::vector<std::pair<std::uint32_t, std::uint32_t> > citations;
+    std::vector<std::size_t> lineOf;
+    std::size_t firstLine = 1;
+    for (auto &piece : parsed) {
+        std::vector<std::uint32_t> toGlobal;
+        toGlobal.reserve(piece.ids.size());
+        for (auto &id : piece.ids) {
+            auto entry = global.try_emplace(std::move(id), std::uint32_t(idOf.size()));
+            if (entry.second)
+                idOf.push_back(&entry.first -> first);
+            toGlobal.push_back(entry.first -> second);
+        }
+        for (std::size_t i = 0; i < piece.citations.size(); ++i) {
+            citations.emplace_back(toGlobal[piece.citations[i].first], toGlobal[piece.citations[i].second]);
+            lineOf.push_back(firstLine + piece.citationLines[i]);
+        }
+        for (auto line : piece.malformedLines)
+            report.issues.push_back({firstLine + line, CitationLoadReport::Problem::malformed_line});
+        firstLine += piece.lines;
+        report.lines += piece.lines;
+    }
+
+    // A new publication is created only if it is reachable from the existing
+    // graph through the loaded citations.
+    std::vector<char> known(idOf.size());
+    for (std::size_t id = 0; id < idOf.size(); ++id)
+        known[id] = graph.exists(*idOf[id]);
+    std::vector<char> isNew(idOf.size());
+    for (std::size_t id = 0; id < idOf.size(); ++id)
+        isNew[id] = !known[id];
+    std::vector<std::vector<std::uint32_t> > citedBy(idOf.size());
+    for (auto const &citation : citations)
+        citedBy[citation.second].push_back(citation.first);
+    std::vector<std::uint32_t> frontier;
+    for (std::uint32_t id = 0; id < idOf.size(); ++id) {
+        if (known[id])
+            frontier.push_back(id);
+    }
+    // New publications in the order they became known, each with the
+    // publication that made it known.
+    std::vector<std::pair<std::uint32_t, std::uint32_t> > discovered;
+    while (!frontier.empty()) {
+        std::uint32_t parent = frontier.back();
+        frontier.pop_back();
+        for (auto child : citedBy[parent]) {
+            if (!known[child]) {
+                known[child] = true;
+                frontier.push_back(child);
+                discovered.emplace_back(child, parent);
+            }
+        }
+    }
+
+    std::vector<id_type> created;
+    std::vector<char> listed(idOf.size());
+    std::vector<std::pair<id_type, id_type> > accepted;
+    std::vector<std::size_t> acceptedLines;
+    for (std::size_t i = 0; i < citations.size(); ++i) {
+        auto child = citations[i].first;
+        auto parent = citations[i].second;
+        if (!known[child] || !known[parent]) {
+            report.issues.push_back({lineOf[i], CitationLoadReport::Problem::unknown_parent});
+            continue;
+        }
+        if (isNew[child] && !listed[child]) {
+            listed[child] = true;
+            created.push_back(*idOf[child]);
+        }
+        accepted.emplace_back(*idOf[child], *idOf[parent]);
+        acceptedLines.push_back(lineOf[i]);
+    }
+
+    std::size_t citationsBefore = graph.memory_stats().citations;
+    try {
+        graph.create_batch(created, accepted);
+    } catch (CitationCycle &) {
+        // Creating a publication cannot close a cycle, and adding a citation
+        // that would throws before changing anything.
+        for (auto const &link : discovered)
+            graph.create(*idOf[link.first], *idOf[link.second]);
+        for (std::size_t i = 0; i < accepted.size(); ++i) {
+            try {
+                graph.add_citation(accepted[i].first, accepted[i].second);
+            } catch (CitationCycle &) {
+                report.issues.push_back({acceptedLines[i], CitationLoadReport::Problem::cycle});
+            }
+        }
+    }
+    std::sort(report.issues.begin(), report.issues.end(), [](auto const &a, auto const &b) {
+        return a.line < b.line;
+    });
+    report.publications_created = created.size();
+    report.citations_added = graph.memory_stats().citations - citationsBefore;
+    return report;
+}
+
+// Maps the file at path and loads it as load_citations(graph, text) does.
+template <class Publication, class... Policies>
+CitationLoadReport load_citation_file(CitationGraph<Publication, Policies...> &graph, std::string const &path,
+                                      CitationLoadOptions const &options = CitationLoadOptions()) {
+    citation_graph_detail::mapped_file file(path);
+    return load_citations(graph, std::string_view(file.data(), file.size()), options);
+}
+
+#endif //CITATION_GRAPH_LOADER_H
@@ -0,0 +1,466 @@
+#ifndef CITATION_GRAPH_LOG_H
+#define CITATION_GRAPH_LOG_H
+
+#include "citation_graph.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define CITATION_GRAPH_HAS_FSYNC 1
+#define CITATION_GRAPH_HAS_FSEEKO 1
+#endif
+
+// Mutation log, version 1: a sequence of records, each
+//   uint32 body length, uint32 FNV-1a hash of the body, body
+// where the body is
+//   uint8 op, uint32 id count, then per id uint32 length and its bytes
+// with ids written by CitationIdCodec. Lengths and counts are little-endian;
+// ids are in whatever byte order the codec writes, as in snapshots. A create
+// lists the new id and then its parents, add_citation the child and then the
+// parent, remove the removed id. Records are only ever appended, so a reader
+// can follow the log while it grows.
+
+class InvalidMutationLog : public std::exception {
+    const char * what () const noexcept override {
+        return "InvalidMutationLog";
+    }
+};
+
+// Where a CitationLog writes. write() must hand the bytes on (to the OS, for
+// a file) before it returns, so that readers following the log see them;
+// sync() must make everything written so far durable.
+class CitationLogSink {
+public:
+    virtual ~CitationLogSink() = default;
+    virtual void write(char const *data, std::size_t size) = 0;
+    virtual void sync() = 0;
+};
+
+// Appends to a file, creating it if needed.
+class CitationLogFile : public CitationLogSink {
+public:
+    explicit CitationLogFile(std::string const &path)
+            : path(path), file(std::fopen(path.c_str(), "ab"), &std::fclose) {
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    void write(char const *data, std::size_t size) override {
+        if ((size != 0 && std::fwrite(data, 1, size, file.get()) != size) || std::fflush(file.get()) != 0)
+            throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    void sync() override {
+#ifdef CITATION_GRAPH_HAS_FSYNC
+        if (::fsync(::fileno(file.get())) != 0)
+            throw std::system_error(errno, std::generic_category(), path);
+#endif
+    }
+
+private:
+    std::string path;
+    std::unique_ptr<std::FILE, int (*)(std::FILE *)> file;
+};
+
+// Keeps the log in memory, e.g. to ship it elsewhere or to test with.
+class CitationLogBuffer : public CitationLogSink {
+public:
+    void write(char const *data, std::size_t size) override {
+        bytes.append(data, size);
+    }
+
+    void sync() override {}
+
+    std::string bytes;
+};
+
+struct CitationLogOptions {
+    // Group commit: records are collected and written together once this
+    // many are pending, or once the oldest pending one has waited
+    // group_delay. That is checked when the next record comes and by
+    // CitationLog::flush_if_due(); a writer that goes idle must call
+    // flush_if_due() every so often, or its last group is only written by
+    // flush() or destruction. Called at least every t, it leaves a record
+    // unwritten for at most group_delay + t, and with periodic sync not yet
+    // durable for at most sync_interval + t after that.
+    std::size_t group_records = 128;
+    std::chrono::milliseconds group_delay {10};
+
+    enum class Sync {
+        // Leave it to the OS.
+        never,
+        // After every group.
+        every_group,
+        // After a group once sync_interval has passed since the last sync.
+        periodic
+    };
+    Sync sync = Sync::every_group;
+    std::chrono::milliseconds sync_interval {1000};
+};
+
+struct CitationReplay {
+    std::size_t records = 0;
+    // Up to the end of the last record applied.
+    std::uint64_t bytes = 0;
+};
+
+namespace citation_graph_detail {
+
+enum class log_op : unsigned char { create = 1, citation = 2, remove = 3 };
+
+inline void put_u32(std::string &out, std::uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8)
+        out.push_back(char((value >> shift) & 0xff));
+}
+
+inline std::uint32_t get_u32(char const *in) noexcept {
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= std::uint32_t(static_cast<unsigned char>(in[i])) << (8 * i);
+    return value;
+}
+
+inline std::uint32_t fnv1a(char const *first, char const *last) noexcept {
+    std::uint32_t hash = 2166136261u;
+    for (; first != last; ++first) {
+        hash ^= static_cast<unsigned char>(*first);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// fseek to an absolute offset, through the widest offset type the platform
+// has. Throws if the offset does not fit in it.
+inline void seek(std::FILE *file, std::uint64_t offset, std::string const &path) {
+#if defined(CITATION_GRAPH_HAS_FSEEKO)
+    using offset_type = off_t;
+#elif defined(_WIN32)
+    using offset_type = __int64;
+#else
+    using offset_type = long;
+#endif
+    if (offset > std::uint64_t(std::numeric_limits<offset_type>::max()))
+        throw std::system_error(EOVERFLOW, std::generic_category(), path);
+#if defined(CITATION_GRAPH_HAS_FSEEKO)
+    int failed = ::fseeko(file, offset_type(offset), SEEK_SET);
+#elif defined(_WIN32)
+    int failed = ::_fseeki64(file, offset_type(offset), SEEK_SET);
+#else
+    int failed = std::fseek(file, offset_type(offset), SEEK_SET);
+#endif
+    if (failed != 0)
+        throw std::system_error(errno, std::generic_category(), path);
+}
+
+template <class Id>
+std::string encode_record(log_op op, std::vector<Id const *> const &ids) {
+    std::string body(1, char(op));
+    put_u32(body, std::uint32_t(ids.size()));
+    for (auto id : ids) {
+        std::size_t at = body.size();
+        put_u32(body, 0);
+        CitationIdCodec<Id>::write(body, *id);
+        std::uint32_t length = std::uint32_t(body.size() - at - 4);
+        for (int i = 0; i < 4; ++i)
+            body[at + i] = char((length >> (8 * i)) & 0xff);
+    }
+    std::string record;
+    record.reserve(8 + body.size());
+    put_u32(record, std::uint32_t(body.size()));
+    put_u32(record, fnv1a(body.data(), body.data() + body.size()));
+    record += body;
+    return record;
+}
+
+// Applies the complete records in [data, data + size), consecutive creates
+// and citations together through create_batch, at most batch_records at a
+// time. progress counts what has been applied, also if this throws.
+template <class Publication, class... Policies>
+void replay_records(CitationGraph<Publication, Policies...> &graph, char const *data, std::size_t size,
+                    std::size_t batch_records, CitationReplay &progress) {
+    using id = typename Publication::id_type;
+    std::vector<id> ids;
+    std::vector<std::pair<id, id> > citations;
+    std::size_t pending = 0;
+    std::size_t position = 0;
+    std::size_t applied = 0;
+    auto settle = [&]() {
+        if (pending != 0)
+            graph.create_batch(ids, citations);
+        ids.clear();
+        citations.clear();
+        progress.records += pending;
+        pending = 0;
+        progress.bytes += position - applied;
+        applied = position;
+    };
+
+    std::vector<id> fields;
+    while (size - position >= 8) {
+        std::uint32_t length = get_u32(data + position);
+        if (size - position - 8 < length)
+            break;
+        char const *body = data + position + 8;
+        char const *end = body + length;
+        if (length < 5 || fnv1a(body, end) != get_u32(data + position + 4))
+            throw InvalidMutationLog();
+        log_op op = log_op(static_cast<unsigned char>(body[0]));
+        std::uint32_t count = get_u32(body + 1);
+        fields.clear();
+        char const *field = body + 5;
+        for (std::uint32_t i = 0; i < count; ++i) {
+            if (end - field < 4 || std::uint32_t(end - field - 4) < get_u32(field))
+                throw InvalidMutationLog();
+            char const *next = field + 4 + get_u32(field);
+            try {
+                fields.push_back(CitationIdCodec<id>::read(field + 4, next));
+            } catch (InvalidSnapshot &) {
+                throw InvalidMutationLog();
+            }
+            field = next;
+        }
+        if (field != end)
+            throw InvalidMutationLog();
+
+        if (op == log_op::create && count >= 2) {
+            ids.push_back(fields[0]);
+            for (std::uint32_t i = 1; i < count; ++i)
+                citations.emplace_back(fields[0], fields[i]);
+            ++pending;
+        } else if (op == log_op::citation && count == 2) {
+            citations.emplace_back(fields[0], fields[1]);
+            ++pending;
+        } else if (op == log_op::remove && count == 1) {
+            settle();
+            graph.remove(fields[0]);
+            ++progress.records;
+        } else {
+            throw InvalidMutationLog();
+        }
+        position += 8 + length;
+        if (op == log_op::remove || pending >= batch_records)
+            settle();
+    }
+    settle();
+}
+
+} // namespace citation_graph_detail
+
+// Buffers encoded records and writes them to its sink in groups; see
+// CitationLogOptions. Write errors surface from reserve() or flush(); a
+// group that fails to be written stays pending. Destruction flushes, but
+// swallows errors, so call flush() first to see them.
+class CitationLog {
+public:
+    explicit CitationLog(std::unique_ptr<CitationLogSink> sink, CitationLogOptions options = CitationLogOptions())
+            : sink(std::move(sink)), options(options), lastSync(clock::now()) {}
+
+    CitationLog(CitationLog const &) = delete;
+    CitationLog &operator=(CitationLog const &) = delete;
+
+    ~CitationLog() {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    // Writes the pending group if it is due, then makes room for a record
+    // of the given size, so that the append() after it cannot fail.
+    void reserve(std::size_t bytes) {
+        if (pending >= options.group_records || group_due())
+            write_group();
+        buffer.reserve(buffer.size() + bytes);
+    }
+
+    // Writes the pending group if it has waited group_delay, and with
+    // periodic sync syncs written groups once sync_interval has passed, so
+    // that an idle writer's last records still reach the sink in time. For
+    // a timer or an event loop on the writer's thread.
+    void flush_if_due() {
+        if (group_due())
+            write_group();
+        else if (unsynced && options.sync == CitationLogOptions::Sync::periodic
+                 && clock::now() - lastSync >= options.sync_interval)
+            sync();
+    }
+
+    void append(std::string const &record) noexcept {
+        if (pending++ == 0)
+            groupStart = clock::now();
+        buffer.append(record);
+    }
+
+    // Writes everything pending and, unless the policy is never, syncs it.
+    void flush() {
+        write_group();
+        if (options.sync != CitationLogOptions::Sync::never)
+            sync();
+    }
+
+    std::size_t pending_records() const noexcept {
+        return pending;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    bool group_due() const noexcept {
+        return pending != 0 && clock::now() - groupStart >= options.group_delay;
+    }
+
+    void write_group() {
+        if (pending == 0)
+            return;
+        sink -> write(buffer.data(), buffer.size());
+        buffer.clear();
+        pending = 0;
+        unsynced = true;
+        if (options.sync == CitationLogOptions::Sync::every_group
+                || (options.sync == CitationLogOptions::Sync::periodic
+                    && clock::now() - lastSync >= options.sync_interval))
+            sync();
+    }
+
+    void sync() {
+        sink -> sync();
+        lastSync = clock::now();
+        unsynced = false;
+    }
+
+    std::unique_ptr<CitationLogSink> sink;
+    CitationLogOptions options;
+    std::string buffer;
+    std::size_t pending = 0;
+    // Groups written since the last sync.
+    bool unsynced = false;
+    clock::time_point groupStart;
+    clock::time_point lastSync;
+};
+
+// A CitationGraph whose successful create, add_citation and remove calls are
+// recorded in a CitationLog, for replicas to replay. Each call keeps the
+// strong guarantee, and is logged if and only if it succeeds. Queries go
+// through graph().
+template <class Publication, class IndexPolicy = DefaultIdIndex<typename Publication::id_type>,
+          class StatsPolicy = NoCitationStats>
+class LoggedCitationGraph {
+public:
+    using graph_type = CitationGraph<Publication, IndexPolicy, StatsPolicy>;
+    using id_type = typename Publication::id_type;
+
+    LoggedCitationGraph(graph_type &&graph, std::unique_ptr<CitationLogSink> sink,
+                        CitationLogOptions options = CitationLogOptions())
+            : current(std::move(graph)), log(std::move(sink), options) {}
+
+    graph_type const &graph() const noexcept {
+        return current;
+    }
+
+    void create(id_type const &id, id_type const &parent_id) {
+        create(id, std::vector<id_type> {parent_id});
+    }
+
+    void create(id_type const &id, std::vector<id_type> const &parent_ids) {
+        std::vector<id_type const *> fields {&id};
+        for (auto const &parent : parent_ids)
+            fields.push_back(&parent);
+        apply(citation_graph_detail::log_op::create, fields, [&]() { current.create(id, parent_ids); });
+    }
+
+    void add_citation(id_type const &child_id, id_type const &parent_id) {
+        apply(citation_graph_detail::log_op::citation, {&child_id, &parent_id},
+              [&]() { current.add_citation(child_id, parent_id); });
+    }
+
+    void remove(id_type const &id) {
+        apply(citation_graph_detail::log_op::remove, {&id}, [&]() { current.remove(id); });
+    }
+
+    void flush() {
+        log.flush();
+    }
+
+    void flush_if_due() {
+        log.flush_if_due();
+    }
+
+private:
+    template <class Mutation>
+    void apply(citation_graph_detail::log_op op, std::vector<id_type const *> const &fields, Mutation &&mutation) {
+        std::string record = citation_graph_detail::encode_record<id_type>(op, fields);
+        log.reserve(record.size());
+        mutation();
+        log.append(record);
+    }
+
+    graph_type current;
+    CitationLog log;
+};
+
+// Applies the complete records in log to graph; a torn record at the end is
+// left for a later call, from the returned byte count on. Consecutive
+// creates and citations are applied together, batch_records at a time, each
+// batch all or nothing; if one fails, the batches before it stay applied.
+// Throws InvalidMutationLog on a damaged record.
+template <class Publication, class... Policies>
+CitationReplay replay(CitationGraph<Publication, Policies...> &graph, std::string_view log,
+                      std::size_t batch_records = 4096) {
+    CitationReplay progress;
+    citation_graph_detail::replay_records(graph, log.data(), log.size(), batch_records, progress);
+    return progress;
+}
+
+// Follows a log file as it grows: each follow() applies what has been
+// appended since the last one. offset() is where the next one starts, and
+// after an exception it is just past the last record that was applied.
+class CitationLogTail {
+public:
+    explicit CitationLogTail(std::string path, std::uint64_t offset = 0) : path(std::move(path)), position(offset) {}
+
+    template <class Publication, class... Policies>
+    CitationReplay follow(CitationGraph<Publication, Policies...> &graph, std::size_t batch_records = 4096) {
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), path);
+        citation_graph_detail::seek(file.get(), position, path);
+        std::string bytes;
+        char chunk[1 << 16];
+        for (std::size_t got; (got = std::fread(chunk, 1, sizeof(chunk), file.get())) > 0;)
+            bytes.append(chunk, got);
+        if (std::ferror(file.get()))
+            throw std::system_error(EIO, std::generic_category(), path);
+
+        CitationReplay progress;
+        try {
+            citation_graph_detail::replay_records(graph, bytes.data(), bytes.size(), batch_records, progress);
+        } catch (...) {
+            position += progress.bytes;
+            throw;
+        }
+        position += progress.bytes;
+        return progress;
+    }
+
+    std::uint64_t offset() const noexcept {
+        return position;
+    }
+
+private:
+    std::string path;
+    std::uint64_t position;
+};
+
+#endif //CITATION_GRAPH_LOG_H
@@ -0,0 +1,278 @@
+#ifndef CITATION_GRAPH_RANK_H
+#define CITATION_GRAPH_RANK_H
+
+#include "citation_graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+struct PageRankOptions {
+    // Probability of following a citation rather than jumping to a random
+    // publication.
+    double damping = 0.85;
+    // Iteration stops once the L1 change of the scores drops below this.
+    double tolerance = 1e-6;
+    std::size_t max_iterations = 100;
+    // 0 means std::thread::hardware_concurrency().
+    unsigned threads = 0;
+    // Graphs with fewer publications plus citations than this are ranked by
+    // the calling thread alone.
+    std::size_t parallel_threshold = 65536;
+};
+
+struct PageRankResult {
+    // Indexed like CompressedCitationGraph::ids; they sum to 1.
+    std::vector<float> scores;
+    std::size_t iterations = 0;
+    // L1 change in the last iteration, and in every one before it.
+    double residual = 0;
+    std::vector<double> residuals;
+    bool converged = false;
+};
+
+namespace citation_graph_detail {
+
+// Threads kept for the length of one call, so that a loop of parallel
+// rounds does not start and join threads every round. run(parts, work)
+// calls work(part) for parts [0, parts) on the pool and the calling thread,
+// which take parts one at a time, and returns once all are done, rethrowing
+// the first failure. If a thread cannot be started, the others take its
+// share.
+class worker_pool {
+public:
+    explicit worker_pool(unsigned threads) : failures(std::max(threads, 1u)) {
+        workers.reserve(failures.size() - 1);
+        try {
+            for (unsigned worker = 1; worker < threads; ++worker)
+                workers.emplace_back([this, worker]() { serve(worker); });
+        } catch (std::system_error &) {
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    worker_pool(worker_pool const &) = delete;
+    worker_pool &operator=(worker_pool const &) = delete;
+
+    ~worker_pool() {
+        stop();
+    }
+
+    unsigned size() const noexcept {
+        return unsigned(workers.size()) + 1;
+    }
+
+    template <class Work>
+    void run(std::size_t parts, Work &&work) {
+        if (workers.empty() || parts <= 1) {
+            for (std::size_t part = 0; part < parts; ++part)
+                work(part);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = [](void *context, std::size_t part) { (*static_cast<std::remove_reference_t<Work> *>(context))(part); };
+            context = const_cast<void *>(static_cast<void const *>(std::addressof(work)));
+            partCount = parts;
+            next = 0;
+            busy = workers.size();
+            ++round;
+        }
+        wake.notify_all();
+        drain(0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this]() { return busy == 0; });
+        }
+        for (auto &failure : failures) {
+            if (failure) {
+                std::exception_ptr first = failure;
+                for (auto &other : failures)
+                    other = nullptr;
+                std::rethrow_exception(first);
+            }
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::vector<std::exception_ptr> failures;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void (*job)(void *, std::size_t) = nullptr;
+    void *context = nullptr;
+    std::size_t partCount = 0;
+    std::atomic<std::size_t> next {0};
+    std::size_t busy = 0;
+    std::size_t round = 0;
+    bool stopping = false;
+
+    void drain(unsigned worker) noexcept {
+        try {
+            for (std::size_t part; (part = next++) < partCount;)
+                job(context, part);
+        } catch (...) {
+            failures[worker] = std::current_exception();
+            next = partCount;
+        }
+    }
+
+    void serve(unsigned worker) {
+        std::size_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || round != seen; });
+                if (stopping)
+                    return;
+                seen = round;
+            }
+            drain(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+
+    void stop() noexcept {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+        workers.clear();
+    }
+};
+
+// Splits rows [0, offsets.size() - 1) into parts of about equal row plus
+// edge count. Returns parts + 1 boundaries.
+inline std::vector<std::size_t> balance_rows(std::vector<std::uint64_t> const &offsets, std::size_t parts) {
+    std::size_t rows = offsets.size() - 1;
+    std::uint64_t total = rows + offsets.back();
+    std::vector<std::size_t> bounds {0};
+    for (std::size_t part = 1; part < parts; ++part) {
+        std::uint64_t target = total * part / parts;
+        std::size_t low = bounds.back();
+        std::size_t high = rows;
+        while (low < high) {
+            std::size_t middle = low + (high - low) / 2;
+            if (middle + offsets[middle] < target)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        bounds.push_back(low);
+    }
+    bounds.push_back(rows);
+    return bounds;
+}
+
+// Sum of values[index[i]] over [first, last), in four independent lanes so
+// the loop pipelines and vectorizes without reassociation flags.
+inline float gather_sum(float const *values, std::uint32_t const *first, std::uint32_t const *last) noexcept {
+    float lane[4] = {0, 0, 0, 0};
+    for (; last - first >= 4; first += 4) {
+        lane[0] += values[first[0]];
+        lane[1] += values[first[1]];
+        lane[2] += values[first[2]];
+        lane[3] += values[first[3]];
+    }
+    for (; first != last; ++first)
+        lane[0] += values[*first];
+    return (lane[0] + lane[1]) + (lane[2] + lane[3]);
+}
+
+} // namespace citation_graph_detail
+
+// PageRank over citations: a publication passes its score on to the ones it
+// cites, so heavily and influentially cited publications rank highest.
+// Publications citing nothing (the root) spread their score evenly. Damped
+// power iteration in a pull formulation: each publication sums its
+// children's contributions from contiguous float arrays, and the rows are
+// split across threads by edge count, so no two threads write the same
+// score. The threads are started once per call and serve every iteration.
+// Deterministic for a given thread count, whether or not the graph is
+// large enough to be ranked in parallel.
+template <class Id>
+PageRankResult page_rank(CompressedCitationGraph<Id> const &graph, PageRankOptions const &options = PageRankOptions()) {
+    PageRankResult result;
+    std::size_t n = graph.ids.size();
+    if (n == 0)
+        return result;
+    unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::size_t parts = std::min<std::size_t>(n, std::size_t(threads) * 4);
+    threads = unsigned(std::min<std::size_t>(threads, parts));
+    std::vector<std::size_t> bounds = citation_graph_detail::balance_rows(graph.child_offsets, parts);
+    bool parallel = n + graph.children.size() >= options.parallel_threshold;
+    citation_graph_detail::worker_pool pool(parallel ? threads : 1);
+
+    // Reciprocal out-degree, 0 for publications that cite nothing.
+    std::vector<float> share(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint64_t cited = graph.parent_offsets[i + 1] - graph.parent_offsets[i];
+        share[i] = cited == 0 ? 0.0f : 1.0f / float(cited);
+    }
+    std::vector<float> score(n, float(1.0 / double(n)));
+    std::vector<float> next(n);
+    std::vector<float> contribution(n);
+    std::vector<double> partResidual(parts);
+    std::vector<double> partDangling(parts);
+    float const damping = float(options.damping);
+
+    while (result.iterations < options.max_iterations) {
+        pool.run(parts, [&](std::size_t part) {
+            double dangling = 0;
+            for (std::size_t i = bounds[part]; i < bounds[part + 1]; ++i) {
+                contribution[i] = score[i] * share[i];
+                if (share[i] == 0)
+                    dangling += score[i];
+            }
+            partDangling[part] = dangling;
+        });
+        double dangling = 0;
+        for (auto value : partDangling)
+            dangling += value;
+        float const base = float(((1 - options.damping) + options.damping * dangling) / double(n));
+
+        pool.run(parts, [&](std::size_t part) {
+            double residual = 0;
+            std::uint32_t const *children = graph.children.data();
+            for (std::size_t i = bounds[part]; i < bounds[part + 1]; ++i) {
+                float sum = citation_graph_detail::gather_sum(contribution.data(),
+                        children + graph.child_offsets[i], children + graph.child_offsets[i + 1]);
+                next[i] = base + damping * sum;
+                residual += std::fabs(double(next[i]) - double(score[i]));
+            }
+            partResidual[part] = residual;
+        });
+        score.swap(next);
+        ++result.iterations;
+        result.residual = 0;
+        for (auto value : partResidual)
+            result.residual += value;
+        result.residuals.push_back(result.residual);
+        if (result.residual < options.tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+    result.scores = std::move(score);
+    return result;
+}
+
+#endif //CITATION_GRAPH_RANK_H
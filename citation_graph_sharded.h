@@ -0,0 +1,224 @@
+#ifndef CITATION_GRAPH_SHARDED_H
+#define CITATION_GRAPH_SHARDED_H
+
+#include "citation_graph.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Multi-writer ingestion. Publications are spread over shards by a hash of
+// their id, each shard with its own lock, id index and node storage, so
+// threads creating publications and citations in different shards do not
+// contend. A call locks every shard it touches in ascending shard order, so
+// cross-shard citations cannot deadlock, and each call keeps the strong
+// exception guarantee. Ingestion only adds, in amortized O(1) per citation
+// under the locks: citation lists are appended to unsorted, a repeated
+// citation is kept until build() drops it, and cycles longer than a
+// self-citation are rejected when build() turns the result into a
+// CitationGraph, which is also where removal and the other queries live.
+template <class Publication, class IndexPolicy = DefaultIdIndex<typename Publication::id_type>,
+          class ShardHash = citation_graph_detail::transparent_hash>
+class ShardedCitationGraph {
+public:
+    using id_type = typename Publication::id_type;
+    using graph_type = CitationGraph<Publication, IndexPolicy>;
+
+    // shard_count is rounded up to a power of two; a few times the number of
+    // writer threads keeps collisions rare.
+    explicit ShardedCitationGraph(id_type const &stem_id, std::size_t shard_count = 64) : rootId(stem_id) {
+        while (shardCount < shard_count)
+            shardCount *= 2;
+        shards = std::make_unique<shard[]>(shardCount);
+        place(shard_of(stem_id), stem_id);
+    }
+
+    ShardedCitationGraph(ShardedCitationGraph const &) = delete;
+    ShardedCitationGraph &operator=(ShardedCitationGraph const &) = delete;
+
+    id_type const &get_root_id() const noexcept {
+        return rootId;
+    }
+
+    void create(id_type const &id, id_type const &parent_id) {
+        create(id, std::vector<id_type> {parent_id});
+    }
+
+    void create(id_type const &id, std::vector<id_type> const &parent_ids) {
+        if (parent_ids.empty())
+            throw PublicationNotFound();
+        std::size_t home = shard_of(id);
+        std::vector<std::size_t> touched {home};
+        for (auto const &parent : parent_ids)
+            touched.push_back(shard_of(parent));
+        auto locks = lock(touched);
+
+        if (shards[home].map.find(id))
+            throw PublicationAlreadyCreated();
+        std::vector<ref> parents;
+        parents.reserve(parent_ids.size());
+        for (auto const &parent : parent_ids)
+            parents.push_back(locate(parent));
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+        for (auto parent : parents)
+            citation_graph_detail::reserve_one(node(parent).children);
+
+        ref child = place(home, id);
+        node(child).parents = std::move(parents);
+        for (auto parent : node(child).parents)
+            node(parent).children.push_back(child);
+    }
+
+    void add_citation(id_type const &child_id, id_type const &parent_id) {
+        auto locks = lock({shard_of(child_id), shard_of(parent_id)});
+        ref child = locate(child_id);
+        ref parent = locate(parent_id);
+        if (child == parent)
+            throw CitationCycle();
+        Node &childNode = node(child);
+        Node &parentNode = node(parent);
+        citation_graph_detail::reserve_one(childNode.parents);
+        citation_graph_detail::reserve_one(parentNode.children);
+        childNode.parents.push_back(parent);
+        parentNode.children.push_back(child);
+    }
+
+    bool exists(id_type const &id) const {
+        shard const &home = shards[shard_of(id)];
+        std::lock_guard<std::mutex> guard(home.lock);
+        return home.map.find(id) != nullptr;
+    }
+
+    std::vector<id_type> get_children(id_type const &id) const {
+        return neighbors(id, &Node::children);
+    }
+
+    std::vector<id_type> get_parents(id_type const &id) const {
+        return neighbors(id, &Node::parents);
+    }
+
+    std::size_t size() const {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            total += shards[i].nodes.size();
+        }
+        return total;
+    }
+
+    // The ingested graph as a CitationGraph. Blocks writers while it reads
+    // the shards; throws CitationCycle if the citations contain a cycle.
+    graph_type build() const {
+        std::vector<std::unique_lock<std::mutex> > locks;
+        locks.reserve(shardCount);
+        for (std::size_t i = 0; i < shardCount; ++i)
+            locks.emplace_back(shards[i].lock);
+        std::vector<id_type> ids;
+        std::vector<std::pair<id_type, id_type> > citations;
+        std::vector<ref> parents;
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            for (std::size_t slot = 0; slot < shards[i].nodes.size(); ++slot) {
+                Node const &current = shards[i].nodes[slot];
+                if (!(current.id == rootId))
+                    ids.push_back(current.id);
+                parents.assign(current.parents.begin(), current.parents.end());
+                std::sort(parents.begin(), parents.end());
+                parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+                for (auto parent : parents)
+                    citations.emplace_back(current.id, node(parent).id);
+            }
+        }
+        return graph_type::build(rootId, ids, citations);
+    }
+
+private:
+    // Shard number in the high half, arena slot in the low half. Nodes are
+    // never removed, so a ref stays valid for the life of the graph.
+    using ref = std::uint64_t;
+
+    struct Node {
+        id_type id;
+        // In citation order, possibly repeated.
+        std::vector<ref> children;
+        std::vector<ref> parents;
+    };
+
+    struct alignas(64) shard {
+        mutable std::mutex lock;
+        citation_graph_detail::chunked_arena<Node> nodes;
+        typename IndexPolicy::template index<id_type, std::uint32_t> map;
+    };
+
+    std::size_t shard_of(id_type const &id) const {
+        return std::size_t(citation_graph_detail::mix64(ShardHash()(id))) & (shardCount - 1);
+    }
+
+    Node &node(ref r) const noexcept {
+        return shards[r >> 32].nodes[std::uint32_t(r)];
+    }
+
+    // The shard of id must be locked.
+    ref locate(id_type const &id) const {
+        std::size_t home = shard_of(id);
+        std::uint32_t const *found = shards[home].map.find(id);
+        if (!found)
+            throw PublicationNotFound();
+        return ref(home) << 32 | *found;
+    }
+
+    // Adds a publication without citations to a locked shard. Strong guarantee.
+    ref place(std::size_t home, id_type const &id) {
+        shard &target = shards[home];
+        std::size_t slot = target.nodes.grow();
+        try {
+            target.nodes[slot].id = id;
+            target.map.insert(id, std::uint32_t(slot));
+        } catch (...) {
+            target.nodes[slot] = Node();
+            target.nodes.shrink();
+            throw;
+        }
+        return ref(home) << 32 | slot;
+    }
+
+    // Locks the given shards, each once, in ascending order.
+    std::vector<std::unique_lock<std::mutex> > lock(std::vector<std::size_t> touched) const {
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        std::vector<std::unique_lock<std::mutex> > locks;
+        locks.reserve(touched.size());
+        for (auto i : touched)
+            locks.emplace_back(shards[i].lock);
+        return locks;
+    }
+
+    // Copies the refs under the publication's own lock, sorts out repeats,
+    // then resolves each under its shard's lock, never holding two at once.
+    std::vector<id_type> neighbors(id_type const &id, std::vector<ref> Node::*list) const {
+        std::vector<ref> refs;
+        {
+            std::lock_guard<std::mutex> guard(shards[shard_of(id)].lock);
+            refs = node(locate(id)).*list;
+        }
+        std::sort(refs.begin(), refs.end());
+        refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+        std::vector<id_type> result;
+        result.reserve(refs.size());
+        for (auto r : refs) {
+            std::lock_guard<std::mutex> guard(shards[r >> 32].lock);
+            result.push_back(node(r).id);
+        }
+        return result;
+    }
+
+    id_type rootId;
+    std::size_t shardCount = 1;
+    std::unique_ptr<shard[]> shards;
+};
+
+#endif //CITATION_GRAPH_SHARDED_H
@@ -0,0 +1,222 @@
+#ifndef CITATION_GRAPH_TRAVERSE_H
+#define CITATION_GRAPH_TRAVERSE_H
+
+#include "citation_graph.h"
+#include "citation_graph_rank.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
+
+struct TraversalOptions {
+    // 0 means std::thread::hardware_concurrency().
+    unsigned threads = 0;
+    // Levels with less work than this are expanded by the calling thread
+    // alone.
+    std::size_t parallel_threshold = 4096;
+    // Direction switching after Beamer et al.: a level is expanded bottom-up,
+    // by asking each unvisited publication whether one of its neighbours is
+    // on the frontier, once the frontier has more than 1 / alpha of the
+    // unexplored edges; and top-down again once the frontier holds fewer
+    // than 1 / beta of the publications.
+    double alpha = 14;
+    double beta = 24;
+};
+
+namespace citation_graph_detail {
+
+// One bit per key. Marking is atomic, so when threads race for the same
+// publication exactly one of them claims it.
+class atomic_bitmap {
+public:
+    explicit atomic_bitmap(std::size_t bits) : words((bits + 63) / 64) {}
+
+    bool test(std::size_t bit) const noexcept {
+        return (words[bit / 64].load(std::memory_order_relaxed) >> (bit % 64)) & 1;
+    }
+
+    // Whether this call set the bit.
+    bool claim(std::size_t bit) noexcept {
+        std::uint64_t mask = std::uint64_t(1) << (bit % 64);
+        return !(words[bit / 64].fetch_or(mask, std::memory_order_relaxed) & mask);
+    }
+
+private:
+    std::vector<std::atomic<std::uint64_t> > words;
+};
+
+// Level-synchronous breadth-first search from sources, following
+// child_keys() if down and parent_keys() otherwise. Each level is cut into
+// parts that threads take one at a time, so a thread that finishes early
+// takes over parts a busy one has not reached; the threads are started by
+// the first level worth splitting and kept until the search ends. Calls
+// visit(key, depth) on the calling thread for every publication first
+// reached at depth 1 to max_depth, level by level and in ascending key order
+// within a level, so the result does not depend on the thread count.
+template <class Graph, class Visitor>
+void expand_cone(Graph const &graph, std::vector<typename Graph::key_type> const &sources, std::size_t max_depth,
+                 bool down, TraversalOptions const &options, Visitor &&visit) {
+    using key_type = typename Graph::key_type;
+    auto forward = [&graph, down](key_type key) {
+        return down ? graph.child_keys(key) : graph.parent_keys(key);
+    };
+    auto backward = [&graph, down](key_type key) {
+        return down ? graph.parent_keys(key) : graph.child_keys(key);
+    };
+    std::size_t bound = graph.key_bound();
+    unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    auto split = [&](std::size_t work, std::size_t units) -> std::size_t {
+        if (work < options.parallel_threshold || threads == 1)
+            return std::min<std::size_t>(units, 1);
+        return std::min(units, std::size_t(threads) * 8);
+    };
+
+    atomic_bitmap visited(bound);
+    std::vector<key_type> frontier;
+    // Edges a bottom-up level would have to look at: the backward edges of
+    // every unvisited publication.
+    std::size_t unexplored = graph.memory_stats().citations;
+    std::size_t live = graph.memory_stats().live_publications;
+    for (auto key : sources) {
+        if (visited.claim(key)) {
+            frontier.push_back(key);
+            unexplored -= backward(key).size();
+        }
+    }
+
+    std::vector<std::vector<key_type> > found;
+    std::vector<std::uint64_t> onFrontier;
+    bool bottomUp = false;
+    // Started by the first level worth splitting, and kept for the rest.
+    std::optional<worker_pool> pool;
+    auto run = [&](std::size_t parts, auto &&work) {
+        if (parts > 1 && !pool)
+            pool.emplace(threads);
+        if (pool)
+            pool -> run(parts, work);
+        else if (parts == 1)
+            work(0);
+    };
+    for (std::size_t depth = 1; depth <= max_depth && !frontier.empty(); ++depth) {
+        std::size_t frontierEdges = 0;
+        for (auto key : frontier)
+            frontierEdges += forward(key).size();
+        if (!bottomUp && double(frontierEdges) * options.alpha > double(unexplored))
+            bottomUp = true;
+        else if (bottomUp && double(frontier.size()) * options.beta < double(live))
+            bottomUp = false;
+
+        std::size_t parts;
+        if (bottomUp) {
+            onFrontier.assign((bound + 63) / 64, 0);
+            for (auto key : frontier)
+                onFrontier[key / 64] |= std::uint64_t(1) << (key % 64);
+            // Parts cover whole words, so each bit is claimed by one thread.
+            std::size_t words = onFrontier.size();
+            parts = split(unexplored + bound, words);
+            found.assign(parts, {});
+            run(parts, [&](std::size_t part) {
+                std::size_t last = std::min(bound, words * (part + 1) / parts * 64);
+                for (std::size_t key = words * part / parts * 64; key < last; ++key) {
+                    if (visited.test(key) || !graph.contains_key(key_type(key)))
+                        continue;
+                    for (auto neighbor : backward(key_type(key))) {
+                        if ((onFrontier[neighbor / 64] >> (neighbor % 64)) & 1) {
+                            visited.claim(key);
+                            found[part].push_back(key_type(key));
+                            break;
+                        }
+                    }
+                }
+            });
+        } else {
+            parts = split(frontierEdges, frontier.size());
+            found.assign(parts, {});
+            run(parts, [&](std::size_t part) {
+                std::size_t last = frontier.size() * (part + 1) / parts;
+                for (std::size_t i = frontier.size() * part / parts; i < last; ++i) {
+                    for (auto neighbor : forward(frontier[i])) {
+                        if (!visited.test(neighbor) && visited.claim(neighbor))
+                            found[part].push_back(neighbor);
+                    }
+                }
+            });
+        }
+
+        frontier.clear();
+        for (auto const &keys : found)
+            frontier.insert(frontier.end(), keys.begin(), keys.end());
+        std::sort(frontier.begin(), frontier.end());
+        for (auto key : frontier) {
+            unexplored -= backward(key).size();
+            visit(key, depth);
+        }
+    }
+}
+
+template <class Graph, class Ids>
+std::vector<typename Graph::key_type> keys_of(Graph const &graph, Ids const &ids) {
+    std::vector<typename Graph::key_type> keys;
+    keys.reserve(ids.size());
+    for (auto const &id : ids)
+        keys.push_back(graph.key_of(id));
+    return keys;
+}
+
+} // namespace citation_graph_detail
+
+// Influence cones: the publications that cite any of ids within max_depth
+// citation generations (descendants), or that any of them cites within
+// max_depth (ancestors). The ids themselves are never listed, even one in
+// the cone of another. Throws PublicationNotFound, before doing any work, if
+// an id does not exist. The graph must not change meanwhile; other reads
+// may run alongside.
+//
+// for_each_* call visit(key, depth) with each publication's key (see
+// CitationGraph::key_type) and its distance from the nearest of ids; the
+// others collect the ids in the same order.
+template <class Publication, class... Policies, class Visitor>
+void for_each_descendant(CitationGraph<Publication, Policies...> const &graph,
+                         std::vector<typename Publication::id_type> const &ids, std::size_t max_depth,
+                         Visitor &&visit, TraversalOptions const &options = TraversalOptions()) {
+    citation_graph_detail::expand_cone(graph, citation_graph_detail::keys_of(graph, ids), max_depth, true,
+                                       options, visit);
+}
+
+template <class Publication, class... Policies, class Visitor>
+void for_each_ancestor(CitationGraph<Publication, Policies...> const &graph,
+                       std::vector<typename Publication::id_type> const &ids, std::size_t max_depth,
+                       Visitor &&visit, TraversalOptions const &options = TraversalOptions()) {
+    citation_graph_detail::expand_cone(graph, citation_graph_detail::keys_of(graph, ids), max_depth, false,
+                                       options, visit);
+}
+
+template <class Publication, class... Policies>
+std::vector<typename Publication::id_type> descendants(CitationGraph<Publication, Policies...> const &graph,
+                                                       std::vector<typename Publication::id_type> const &ids,
+                                                       std::size_t max_depth,
+                                                       TraversalOptions const &options = TraversalOptions()) {
+    std::vector<typename Publication::id_type> result;
+    for_each_descendant(graph, ids, max_depth, [&](auto key, std::size_t) {
+        result.push_back(graph.id_of(key));
+    }, options);
+    return result;
+}
+
+template <class Publication, class... Policies>
+std::vector<typename Publication::id_type> ancestors(CitationGraph<Publication, Policies...> const &graph,
+                                                     std::vector<typename Publication::id_type> const &ids,
+                                                     std::size_t max_depth,
+                                                     TraversalOptions const &options = TraversalOptions()) {
+    std::vector<typename Publication::id_type> result;
+    for_each_ancestor(graph, ids, max_depth, [&](auto key, std::size_t) {
+        result.push_back(graph.id_of(key));
+    }, options);
+    return result;
+}
+
+#endif //CITATION_GRAPH_TRAVERSE_H